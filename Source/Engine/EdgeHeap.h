@@ -0,0 +1,141 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Indexed binary min-heap of half-edge costs. Every id keeps its slot in the heap so a cost can be
+// re-keyed or removed in O(log n) without searching for it.
+class EdgeHeap
+{
+public:
+	static constexpr uint32_t INVALID = 0xFFFFFFFFu;
+
+public:
+	void Reset(size_t capacity)
+	{
+		m_Heap.clear();
+		m_Position.assign(capacity, INVALID);
+	}
+
+	// Bulk load without ordering; call Build() once all entries were added.
+	void Append(uint32_t id, float cost)
+	{
+		m_Position[id] = (uint32_t)m_Heap.size();
+		m_Heap.push_back({ cost, id });
+	}
+
+	void Build()
+	{
+		for (size_t i = m_Heap.size() / 2; i-- > 0;)
+			SiftDown(i);
+	}
+
+	// Inserts the id or moves it to its new cost if it is already queued.
+	void Update(uint32_t id, float cost)
+	{
+		uint32_t pos = m_Position[id];
+		if (pos == INVALID)
+		{
+			Append(id, cost);
+			SiftUp(m_Heap.size() - 1);
+			return;
+		}
+
+		float old = m_Heap[pos].cost;
+		m_Heap[pos].cost = cost;
+		if (cost < old) SiftUp(pos);
+		else SiftDown(pos);
+	}
+
+	void Remove(uint32_t id)
+	{
+		uint32_t pos = m_Position[id];
+		if (pos == INVALID)
+			return;
+
+		m_Position[id] = INVALID;
+		Entry last = m_Heap.back();
+		m_Heap.pop_back();
+		if (pos == m_Heap.size())
+			return;
+
+		float old = m_Heap[pos].cost;
+		m_Heap[pos] = last;
+		m_Position[last.id] = pos;
+		if (last.cost < old) SiftUp(pos);
+		else SiftDown(pos);
+	}
+
+	// Renames every queued id after the ids were renumbered; the heap order is untouched.
+	void Remap(const std::vector<uint32_t>& remap, size_t capacity)
+	{
+		m_Position.assign(capacity, INVALID);
+		for (size_t pos = 0; pos < m_Heap.size(); ++pos)
+		{
+			m_Heap[pos].id = remap[m_Heap[pos].id];
+			m_Position[m_Heap[pos].id] = (uint32_t)pos;
+		}
+	}
+
+	uint32_t Pop()
+	{
+		uint32_t id = m_Heap.front().id;
+		Remove(id);
+		return id;
+	}
+
+	inline bool Empty() const { return m_Heap.empty(); }
+	inline size_t Size() const { return m_Heap.size(); }
+	inline uint32_t Top() const { return m_Heap.front().id; }
+	inline float TopCost() const { return m_Heap.front().cost; }
+	inline bool Contains(uint32_t id) const { return m_Position[id] != INVALID; }
+	inline size_t MemoryBytes() const { return m_Heap.capacity() * sizeof(Entry) + m_Position.capacity() * sizeof(uint32_t); }
+
+private:
+	struct Entry
+	{
+		float cost;
+		uint32_t id;
+	};
+
+	void SiftUp(size_t pos)
+	{
+		Entry e = m_Heap[pos];
+		while (pos > 0)
+		{
+			size_t parent = (pos - 1) / 2;
+			if (!(e.cost < m_Heap[parent].cost))
+				break;
+			m_Heap[pos] = m_Heap[parent];
+			m_Position[m_Heap[pos].id] = (uint32_t)pos;
+			pos = parent;
+		}
+		m_Heap[pos] = e;
+		m_Position[e.id] = (uint32_t)pos;
+	}
+
+	void SiftDown(size_t pos)
+	{
+		const size_t count = m_Heap.size();
+		Entry e = m_Heap[pos];
+		for (;;)
+		{
+			size_t child = pos * 2 + 1;
+			if (child >= count)
+				break;
+			if (child + 1 < count && m_Heap[child + 1].cost < m_Heap[child].cost)
+				++child;
+			if (!(m_Heap[child].cost < e.cost))
+				break;
+			m_Heap[pos] = m_Heap[child];
+			m_Position[m_Heap[pos].id] = (uint32_t)pos;
+			pos = child;
+		}
+		m_Heap[pos] = e;
+		m_Position[e.id] = (uint32_t)pos;
+	}
+
+private:
+	std::vector<Entry> m_Heap;
+	std::vector<uint32_t> m_Position;
+};
@@ -0,0 +1,66 @@
+#include "HalfEdgeMesh.h"
+#include "Trace.h"
+
+void HalfEdgeMesh::Reset(size_t face_count)
+{
+    origin.assign(face_count * 3, INVALID);
+    twin.assign(face_count * 3, INVALID);
+    live.resize(face_count);
+    slot.resize(face_count);
+    for (uint32_t face = 0; face < (uint32_t)face_count; ++face)
+    {
+        live[face] = face;
+        slot[face] = face;
+    }
+}
+
+void HalfEdgeMesh::RemoveFace(uint32_t face)
+{
+    uint32_t pos = slot[face];
+    uint32_t last = live.back();
+    live[pos] = last;
+    slot[last] = pos;
+    live.pop_back();
+    slot[face] = INVALID;
+
+    for (uint32_t h = face * 3; h < face * 3 + 3; ++h)
+        twin[h] = INVALID;
+}
+
+bool HalfEdgeMesh::CompactIfNeeded(std::vector<uint32_t>& remap)
+{
+    const size_t face_count = FaceCount();
+    if (face_count == 0 || (float)(face_count - live.size()) < COMPACT_DEAD_FRACTION * (float)face_count)
+        return false;
+
+    QEM_TRACE_SCOPE("CompactTopology");
+    remap.assign(face_count * 3, INVALID);
+    for (uint32_t pos = 0; pos < (uint32_t)live.size(); ++pos)
+    {
+        uint32_t face = live[pos];
+        for (uint32_t k = 0; k < 3; ++k)
+            remap[face * 3 + k] = pos * 3 + k;
+    }
+
+    std::vector<uint32_t> new_origin(live.size() * 3);
+    std::vector<uint32_t> new_twin(live.size() * 3);
+    for (uint32_t pos = 0; pos < (uint32_t)live.size(); ++pos)
+    {
+        uint32_t face = live[pos];
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            uint32_t h = face * 3 + k;
+            new_origin[pos * 3 + k] = origin[h];
+            new_twin[pos * 3 + k] = (twin[h] == INVALID) ? INVALID : remap[twin[h]];
+        }
+        live[pos] = pos;
+    }
+
+    origin.swap(new_origin);
+    twin.swap(new_twin);
+    slot.resize(live.size());
+    for (uint32_t pos = 0; pos < (uint32_t)live.size(); ++pos)
+        slot[pos] = pos;
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index-based halfedge topology. The three halfedges of a triangle are stored consecutively, so the
+// face of halfedge h is h / 3 and next/prev are implied by the index: only origin and twin are stored.
+struct HalfEdgeMesh
+{
+	static constexpr uint32_t INVALID = 0xFFFFFFFFu;
+	static constexpr float COMPACT_DEAD_FRACTION = 0.5f;
+
+	std::vector<uint32_t> origin; // vertex the halfedge leaves from.
+	std::vector<uint32_t> twin;   // opposite halfedge, INVALID on boundary or non-manifold edges.
+	std::vector<uint32_t> live;   // dense list of live faces.
+	std::vector<uint32_t> slot;   // per face, its position in 'live' or INVALID once collapsed.
+
+	static inline uint32_t Face(uint32_t h) { return h / 3; }
+	static inline uint32_t Next(uint32_t h) { return (h % 3 == 2) ? h - 2 : h + 1; }
+	static inline uint32_t Prev(uint32_t h) { return (h % 3 == 0) ? h + 2 : h - 1; }
+
+	inline uint32_t Dest(uint32_t h) const { return origin[Next(h)]; }
+	inline bool IsAlive(uint32_t face) const { return slot[face] != INVALID; }
+	inline size_t HalfEdgeCount() const { return origin.size(); }
+	inline size_t FaceCount() const { return slot.size(); }
+	inline size_t LiveFaceCount() const { return live.size(); }
+
+	void Reset(size_t face_count);
+	void RemoveFace(uint32_t face); // O(1) swap-remove from 'live'.
+
+	// Once too many faces are dead, renumbers the live ones densely in 'live' order. Fills 'remap' with
+	// the new index of every old halfedge (INVALID for dead ones) and returns true if it compacted.
+	bool CompactIfNeeded(std::vector<uint32_t>& remap);
+};
@@ -0,0 +1,105 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const char* file_name)
+{
+    Close();
+    HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    m_File = file;
+    m_Size = (size_t)size.QuadPart;
+    if (m_Size == 0)
+        return true;
+
+    m_Mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_Data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_Data) UnmapViewOfFile(m_Data);
+    if (m_Mapping) CloseHandle((HANDLE)m_Mapping);
+    if (m_File) CloseHandle((HANDLE)m_File);
+    m_Data = nullptr;
+    m_Mapping = nullptr;
+    m_File = nullptr;
+    m_Size = 0;
+}
+#else
+bool MappedFile::Open(const char* file_name)
+{
+    Close();
+    int file = open(file_name, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(file, &st) != 0)
+    {
+        close(file);
+        return false;
+    }
+
+    m_File = file;
+    m_Size = (size_t)st.st_size;
+    if (m_Size == 0)
+        return true;
+
+    void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    madvise(data, m_Size, MADV_SEQUENTIAL);
+    m_Data = (const char*)data;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_Data) munmap((void*)m_Data, m_Size);
+    if (m_File >= 0) close(m_File);
+    m_Data = nullptr;
+    m_File = -1;
+    m_Size = 0;
+}
+#endif
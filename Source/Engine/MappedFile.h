@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+	bool Open(const char* file_name);
+	void Close();
+
+public:
+	inline const char* Data() const { return m_Data; }
+	inline size_t Size() const { return m_Size; }
+
+private:
+	const char* m_Data = nullptr;
+	size_t m_Size = 0;
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#else
+	int m_File = -1;
+#endif
+};
@@ -0,0 +1,38 @@
+#include "Memory.h"
+#include <atomic>
+
+namespace
+{
+    // Constant-initialized: allocations from static constructors run before any dynamic init.
+    std::atomic<size_t> g_Current(0);
+    std::atomic<size_t> g_Peak(0);
+    std::atomic<size_t> g_Blocks(0);
+}
+
+namespace Memory
+{
+    size_t HeapCurrent() { return g_Current.load(std::memory_order_relaxed); }
+    size_t HeapPeak() { return g_Peak.load(std::memory_order_relaxed); }
+    size_t HeapBlocks() { return g_Blocks.load(std::memory_order_relaxed); }
+
+    void ResetPeak()
+    {
+        g_Peak.store(g_Current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    void OnAllocate(size_t bytes)
+    {
+        const size_t current = g_Current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        g_Blocks.fetch_add(1, std::memory_order_relaxed);
+        size_t peak = g_Peak.load(std::memory_order_relaxed);
+        while (current > peak && !g_Peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void OnFree(size_t bytes)
+    {
+        g_Current.fetch_sub(bytes, std::memory_order_relaxed);
+        g_Blocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
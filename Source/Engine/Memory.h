@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Process heap accounting. The counters are fed by the counting operator new/delete of
+// MemoryHooks.cpp, compiled into the executables that want them (qem-simplify, qem-bench): it
+// charges the allocator's real block size, so per-allocation rounding is included. Without the
+// hooks every counter stays 0.
+namespace Memory
+{
+	size_t HeapCurrent();     // bytes in live blocks.
+	size_t HeapPeak();        // highest HeapCurrent() since the last ResetPeak().
+	size_t HeapBlocks();      // live blocks.
+	void ResetPeak();         // process-wide: concurrent models share the high-water mark.
+	inline bool Counting() { return HeapBlocks() != 0; }
+
+	void OnAllocate(size_t bytes);
+	void OnFree(size_t bytes);
+
+	template<typename T>
+	inline size_t Bytes(const std::vector<T>& v) { return v.capacity() * sizeof(T); }
+}
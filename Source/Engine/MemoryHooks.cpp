@@ -0,0 +1,96 @@
+// Counting replacement of the global operator new/delete, feeding Memory.h. Compile it into an
+// executable, not a library: a program has one definition of these operators.
+#include "Memory.h"
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define QEM_BLOCK_SIZE(p) _msize(p)
+#define QEM_ALIGNED_ALLOC(size, align) _aligned_malloc(size, align)
+#define QEM_ALIGNED_FREE(p) _aligned_free(p)
+#define QEM_ALIGNED_BLOCK_SIZE(p, align) _aligned_msize(p, align, 0)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define QEM_BLOCK_SIZE(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define QEM_BLOCK_SIZE(p) malloc_usable_size(p)
+#endif
+
+#ifndef QEM_ALIGNED_ALLOC
+#define QEM_ALIGNED_ALLOC(size, align) AlignedAlloc(size, align)
+#define QEM_ALIGNED_FREE(p) std::free(p)
+#define QEM_ALIGNED_BLOCK_SIZE(p, align) QEM_BLOCK_SIZE(p)
+#endif
+
+namespace
+{
+#ifndef _WIN32
+    void* AlignedAlloc(size_t size, size_t align)
+    {
+        void* p = nullptr;
+        return posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align, size ? size : 1) == 0 ? p : nullptr;
+    }
+#endif
+
+    void* Allocate(size_t size, bool nothrow)
+    {
+        void* p = std::malloc(size ? size : 1);
+        if (!p)
+        {
+            if (nothrow) return nullptr;
+            throw std::bad_alloc();
+        }
+        Memory::OnAllocate(QEM_BLOCK_SIZE(p));
+        return p;
+    }
+
+    void Free(void* p)
+    {
+        if (!p) return;
+        Memory::OnFree(QEM_BLOCK_SIZE(p));
+        std::free(p);
+    }
+
+    void* AllocateAligned(size_t size, std::align_val_t align, bool nothrow)
+    {
+        void* p = QEM_ALIGNED_ALLOC(size ? size : 1, (size_t)align);
+        if (!p)
+        {
+            if (nothrow) return nullptr;
+            throw std::bad_alloc();
+        }
+        Memory::OnAllocate(QEM_ALIGNED_BLOCK_SIZE(p, (size_t)align));
+        return p;
+    }
+
+    void FreeAligned(void* p, [[maybe_unused]] std::align_val_t align) // only _aligned_msize reads it.
+    {
+        if (!p) return;
+        Memory::OnFree(QEM_ALIGNED_BLOCK_SIZE(p, (size_t)align));
+        QEM_ALIGNED_FREE(p);
+    }
+}
+
+void* operator new(size_t size) { return Allocate(size, false); }
+void* operator new[](size_t size) { return Allocate(size, false); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size, true); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size, true); }
+void operator delete(void* p) noexcept { Free(p); }
+void operator delete[](void* p) noexcept { Free(p); }
+void operator delete(void* p, size_t) noexcept { Free(p); }
+void operator delete[](void* p, size_t) noexcept { Free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { Free(p); }
+
+void* operator new(size_t size, std::align_val_t align) { return AllocateAligned(size, align, false); }
+void* operator new[](size_t size, std::align_val_t align) { return AllocateAligned(size, align, false); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return AllocateAligned(size, align, true); }
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return AllocateAligned(size, align, true); }
+void operator delete(void* p, std::align_val_t align) noexcept { FreeAligned(p, align); }
+void operator delete[](void* p, std::align_val_t align) noexcept { FreeAligned(p, align); }
+void operator delete(void* p, size_t, std::align_val_t align) noexcept { FreeAligned(p, align); }
+void operator delete[](void* p, size_t, std::align_val_t align) noexcept { FreeAligned(p, align); }
+void operator delete(void* p, std::align_val_t align, const std::nothrow_t&) noexcept { FreeAligned(p, align); }
+void operator delete[](void* p, std::align_val_t align, const std::nothrow_t&) noexcept { FreeAligned(p, align); }
@@ -0,0 +1,183 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char MESH_CACHE_MAGIC[8] = { 'Q', 'E', 'M', 'C', 'A', 'C', 'H', 'E' };
+    constexpr uint32_t MESH_CACHE_VERSION = 4;
+    constexpr size_t MESH_CACHE_ALIGN = 16;
+    constexpr size_t VALIDATE_GRAIN = 1 << 16;
+
+    struct MeshCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertex_size;
+        uint32_t quadric_size;
+        uint32_t reserved;
+        MeshCacheKey key;
+        uint64_t vertex_count;
+        uint64_t index_count;
+        uint32_t boundary_edges;
+        uint32_t non_manifold_edges;
+    };
+
+    inline size_t Align(size_t offset) { return (offset + MESH_CACHE_ALIGN - 1) & ~(MESH_CACHE_ALIGN - 1); }
+}
+
+bool ComputeMeshCacheKey(const char* source_name, const LoadOptions& options, MeshCacheKey& key)
+{
+    // Size and modification time, as make does: hashing the source would read the whole OBJ on
+    // every load, which is the cost the cache is there to avoid.
+    std::error_code error;
+    const uintmax_t size = fs::file_size(source_name, error);
+    if (error)
+        return false;
+    const fs::file_time_type time = fs::last_write_time(source_name, error);
+    if (error)
+        return false;
+
+    std::memset(&key, 0, sizeof(key));
+    key.source_size = (uint64_t)size;
+    key.source_time = (int64_t)time.time_since_epoch().count();
+    key.weld_mode = (uint32_t)options.weld;
+    key.weld_eps = options.weld_eps;
+    return true;
+}
+
+bool ReadMeshCache(const char* cache_name, const MeshCacheKey& key, Mesh& mesh, std::vector<Quadric>& quadrics,
+    std::vector<uint32_t>& twin, uint32_t& boundary_edges, uint32_t& non_manifold_edges)
+{
+    QEM_TRACE_SCOPE("ReadMeshCache");
+    MappedFile file;
+    if (!file.Open(cache_name) || file.Size() < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+        header.version != MESH_CACHE_VERSION || header.vertex_size != sizeof(Vertex) || header.quadric_size != sizeof(Quadric) ||
+        std::memcmp(&header.key, &key, sizeof(MeshCacheKey)) != 0)
+        return false;
+
+    // Counts are bounded by the file length before any offset is derived from them, so a corrupt
+    // header cannot overflow the section arithmetic.
+    const uint64_t vertex_count = header.vertex_count, index_count = header.index_count;
+    if (vertex_count > file.Size() / sizeof(Vertex) || index_count > file.Size() / sizeof(uint32_t) || index_count % 3 != 0)
+        return false;
+
+    const size_t vertex_offset = Align(sizeof(MeshCacheHeader));
+    const size_t quadric_offset = Align(vertex_offset + vertex_count * sizeof(Vertex));
+    const size_t index_offset = Align(quadric_offset + vertex_count * sizeof(Quadric));
+    const size_t twin_offset = Align(index_offset + index_count * sizeof(uint32_t));
+    const size_t end = twin_offset + index_count * sizeof(uint32_t);
+    if (end != file.Size())
+        return false;
+
+    // The engine edits these arrays in place, so they get private memory, but each is filled by one
+    // copy straight from the mapping: resize() would zero them first.
+    const Vertex* vertices = reinterpret_cast<const Vertex*>(file.Data() + vertex_offset);
+    const Quadric* vertex_quadrics = reinterpret_cast<const Quadric*>(file.Data() + quadric_offset);
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(file.Data() + index_offset);
+    const uint32_t* twins = reinterpret_cast<const uint32_t*>(file.Data() + twin_offset);
+    mesh.vtx.assign(vertices, vertices + vertex_count);
+    quadrics.assign(vertex_quadrics, vertex_quadrics + vertex_count);
+    mesh.idx.assign(indices, indices + index_count);
+    twin.assign(twins, twins + index_count);
+
+    // Every index and twin is dereferenced without checks later on: one out of range, or a twin that
+    // does not point back, makes the whole file a miss.
+    std::atomic<bool> valid(true);
+    Parallel::For(index_count, VALIDATE_GRAIN, [&](size_t first, size_t last, size_t)
+    {
+        bool ok = true;
+        for (size_t h = first; h < last; ++h)
+        {
+            const uint32_t t = twin[h];
+            ok = ok && mesh.idx[h] < vertex_count && (t == HalfEdgeMesh::INVALID || (t < index_count && twin[t] == h));
+        }
+        if (!ok)
+            valid.store(false, std::memory_order_relaxed);
+    });
+    if (!valid.load())
+    {
+        mesh.vtx.clear();
+        mesh.idx.clear();
+        quadrics.clear();
+        twin.clear();
+        return false;
+    }
+
+    boundary_edges = header.boundary_edges;
+    non_manifold_edges = header.non_manifold_edges;
+    return true;
+}
+
+bool WriteMeshCache(const char* cache_name, const MeshCacheKey& key, const Mesh& mesh, const std::vector<Quadric>& quadrics,
+    const std::vector<uint32_t>& twin, uint32_t boundary_edges, uint32_t non_manifold_edges)
+{
+    QEM_TRACE_SCOPE("WriteMeshCache");
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.vertex_size = sizeof(Vertex);
+    header.quadric_size = sizeof(Quadric);
+    header.key = key;
+    header.vertex_count = mesh.vtx.size();
+    header.index_count = mesh.idx.size();
+    header.boundary_edges = boundary_edges;
+    header.non_manifold_edges = non_manifold_edges;
+
+    // Written aside and renamed, so a concurrent reader never maps a half-written cache. The name
+    // is unique per process and call, concurrent writers of the same cache never share it.
+    static std::atomic<uint32_t> s_TempCounter(0);
+    const std::string temp_name = std::string(cache_name) + "." + std::to_string((long long)getpid()) + "." +
+        std::to_string(s_TempCounter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+    FILE* file = fopen(temp_name.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    const char padding[MESH_CACHE_ALIGN] = {};
+    size_t offset = 0;
+    auto Write = [&](const void* data, size_t bytes)
+    {
+        size_t aligned = Align(offset);
+        bool ok = fwrite(padding, 1, aligned - offset, file) == aligned - offset;
+        ok = ok && (bytes == 0 || fwrite(data, 1, bytes, file) == bytes);
+        offset = aligned + bytes;
+        return ok;
+    };
+
+    bool ok = Write(&header, sizeof(header));
+    ok = ok && Write(mesh.vtx.data(), mesh.vtx.size() * sizeof(Vertex));
+    ok = ok && Write(quadrics.data(), quadrics.size() * sizeof(Quadric));
+    ok = ok && Write(mesh.idx.data(), mesh.idx.size() * sizeof(uint32_t));
+    ok = ok && Write(twin.data(), twin.size() * sizeof(uint32_t));
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok)
+    {
+        std::remove(cache_name);
+        ok = std::rename(temp_name.c_str(), cache_name) == 0;
+    }
+    if (!ok)
+        std::remove(temp_name.c_str());
+    return ok;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Model.h"
+#include <cstdint>
+#include <vector>
+
+// Identifies the preprocessed state of one source file: its size, last write and the weld that
+// produced it.
+struct MeshCacheKey
+{
+	uint64_t source_size;
+	int64_t source_time; // last write, in ticks of the filesystem clock.
+	uint32_t weld_mode;
+	float weld_eps;
+};
+
+bool ComputeMeshCacheKey(const char* source_name, const LoadOptions& options, MeshCacheKey& key);
+
+// The cache is a versioned header followed by the welded vertices, their initial quadrics, the index
+// buffer and the twin of every halfedge, each section 16-byte aligned so it can be used from a
+// mapping. Reading fails, and the caller rebuilds, when the file is missing, truncated or corrupt,
+// from another version or layout, or was produced from another source or weld.
+bool ReadMeshCache(const char* cache_name, const MeshCacheKey& key, Mesh& mesh, std::vector<Quadric>& quadrics,
+	std::vector<uint32_t>& twin, uint32_t& boundary_edges, uint32_t& non_manifold_edges);
+bool WriteMeshCache(const char* cache_name, const MeshCacheKey& key, const Mesh& mesh, const std::vector<Quadric>& quadrics,
+	const std::vector<uint32_t>& twin, uint32_t boundary_edges, uint32_t non_manifold_edges);
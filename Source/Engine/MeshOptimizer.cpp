@@ -0,0 +1,293 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+    // Triangles around every vertex, CSR layout.
+    struct VertexTriangles
+    {
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> triangles;
+
+        VertexTriangles(const std::vector<unsigned int>& idx, size_t vertex_count)
+            : first(vertex_count + 1, 0), triangles(idx.size())
+        {
+            for (unsigned int v : idx)
+                ++first[v + 1];
+            for (size_t v = 0; v < vertex_count; ++v)
+                first[v + 1] += first[v];
+
+            std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+            for (size_t c = 0; c < idx.size(); ++c)
+                triangles[fill[idx[c]]++] = (uint32_t)(c / 3);
+        }
+    };
+
+    // FIFO cache of 'cache_size' entries: a vertex stamped at t is cached while time - t <= cache_size.
+    struct CacheSim
+    {
+        std::vector<uint32_t> stamp;
+        uint32_t time;
+        uint32_t size;
+
+        CacheSim(size_t vertex_count, uint32_t cache_size)
+            : stamp(vertex_count, 0), time(cache_size + 1), size(cache_size) {}
+
+        inline bool Cached(uint32_t v) const { return time - stamp[v] <= size; }
+
+        // Returns true on a miss.
+        inline bool Access(uint32_t v)
+        {
+            if (Cached(v))
+                return false;
+            stamp[v] = time++;
+            return true;
+        }
+
+        inline void Flush() { time += size + 1; }
+    };
+
+    size_t CountMisses(const std::vector<unsigned int>& idx, size_t first, size_t last, CacheSim& cache)
+    {
+        size_t misses = 0;
+        for (size_t c = first; c < last; ++c)
+            misses += cache.Access(idx[c]);
+        return misses;
+    }
+
+    // Sander, Nehab, Barczak: fan out from the current vertex, continue from the one that stays in
+    // the cache longest without being evicted before its remaining triangles are emitted. Output
+    // triangle positions where the walk had to jump start a new cluster.
+    void Tipsify(const std::vector<unsigned int>& idx, size_t vertex_count, uint32_t cache_size,
+        std::vector<uint32_t>& order, std::vector<uint32_t>& clusters)
+    {
+        const VertexTriangles adjacency(idx, vertex_count);
+        const size_t triangle_count = idx.size() / 3;
+
+        std::vector<uint32_t> live(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v)
+            live[v] = adjacency.first[v + 1] - adjacency.first[v];
+
+        std::vector<uint8_t> emitted(triangle_count, 0);
+        std::vector<uint32_t> dead_end;
+        std::vector<uint32_t> candidates;
+        CacheSim cache(vertex_count, cache_size);
+        uint32_t cursor = 0;
+
+        order.clear();
+        order.reserve(triangle_count);
+        clusters.clear();
+
+        uint32_t fan = NONE;
+        while (cursor < vertex_count && live[cursor] == 0)
+            ++cursor;
+        if (cursor < vertex_count)
+        {
+            fan = cursor;
+            clusters.push_back(0);
+        }
+
+        while (fan != NONE)
+        {
+            candidates.clear();
+            for (uint32_t i = adjacency.first[fan]; i < adjacency.first[fan + 1]; ++i)
+            {
+                const uint32_t t = adjacency.triangles[i];
+                if (emitted[t])
+                    continue;
+                emitted[t] = 1;
+                order.push_back(t);
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    const uint32_t v = idx[t * 3 + k];
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    cache.Access(v);
+                }
+            }
+
+            uint32_t next = NONE;
+            int best = -1;
+            for (uint32_t v : candidates)
+            {
+                if (live[v] == 0)
+                    continue;
+                int priority = 0;
+                if (cache.time - cache.stamp[v] + 2 * live[v] <= cache_size)
+                    priority = (int)(cache.time - cache.stamp[v]);
+                if (priority > best)
+                {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            if (next == NONE)
+            {
+                while (!dead_end.empty() && next == NONE)
+                {
+                    const uint32_t v = dead_end.back();
+                    dead_end.pop_back();
+                    if (live[v] > 0)
+                        next = v;
+                }
+                while (next == NONE && cursor < vertex_count)
+                {
+                    if (live[cursor] > 0)
+                        next = cursor;
+                    ++cursor;
+                }
+                if (next != NONE && !cache.Cached(next))
+                    clusters.push_back((uint32_t)order.size());
+            }
+            fan = next;
+        }
+    }
+
+    // Splits clusters wherever the prefix already has an ACMR within 'threshold' of the whole
+    // cluster, so sorting them later costs at most that much cache efficiency.
+    void SplitClusters(const std::vector<unsigned int>& idx, size_t vertex_count, uint32_t cache_size, float threshold,
+        std::vector<uint32_t>& clusters)
+    {
+        CacheSim cache(vertex_count, cache_size);
+        std::vector<uint32_t> split;
+        const size_t triangle_count = idx.size() / 3;
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            const size_t first = clusters[c], last = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+            cache.Flush();
+            const float acmr = (float)CountMisses(idx, first * 3, last * 3, cache) / (float)(last - first);
+
+            cache.Flush();
+            size_t start = first, misses = 0;
+            split.push_back((uint32_t)start);
+            for (size_t t = first; t < last; ++t)
+            {
+                misses += CountMisses(idx, t * 3, t * 3 + 3, cache);
+                if (t + 1 < last && (float)misses <= threshold * acmr * (float)(t + 1 - start))
+                {
+                    start = t + 1;
+                    misses = 0;
+                    split.push_back((uint32_t)start);
+                    cache.Flush();
+                }
+            }
+        }
+        clusters.swap(split);
+    }
+
+    // Clusters facing away from the centre go first: they are the ones most likely to occlude.
+    void SortClusters(std::vector<unsigned int>& idx, const std::vector<Vertex>& vtx, const std::vector<uint32_t>& clusters)
+    {
+        const size_t triangle_count = idx.size() / 3;
+        glm::dvec3 center(0.0);
+        double total_area = 0.0;
+        std::vector<glm::dvec3> centroid(clusters.size(), glm::dvec3(0.0)), normal(clusters.size(), glm::dvec3(0.0));
+        std::vector<double> area(clusters.size(), 0.0);
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            const size_t last = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+            for (size_t t = clusters[c]; t < last; ++t)
+            {
+                const glm::dvec3 p0 = vtx[idx[t * 3 + 0]].position, p1 = vtx[idx[t * 3 + 1]].position, p2 = vtx[idx[t * 3 + 2]].position;
+                const glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+                const double a = glm::length(n) * 0.5;
+                centroid[c] += (p0 + p1 + p2) * (a / 3.0);
+                normal[c] += n;
+                area[c] += a;
+            }
+            center += centroid[c];
+            total_area += area[c];
+        }
+        if (total_area > 0.0)
+            center /= total_area;
+
+        std::vector<std::pair<double, uint32_t>> keys(clusters.size());
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            const double length = glm::length(normal[c]);
+            const glm::dvec3 mid = area[c] > 0.0 ? centroid[c] / area[c] : center;
+            keys[c] = { length > 0.0 ? glm::dot(mid - center, normal[c] / length) : 0.0, (uint32_t)c };
+        }
+        std::stable_sort(keys.begin(), keys.end(), [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) { return a.first > b.first; });
+
+        std::vector<unsigned int> sorted;
+        sorted.reserve(idx.size());
+        for (const std::pair<double, uint32_t>& key : keys)
+        {
+            const size_t c = key.second, last = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+            sorted.insert(sorted.end(), idx.begin() + clusters[c] * 3, idx.begin() + last * 3);
+        }
+        idx.swap(sorted);
+    }
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& idx, size_t vertex_count, unsigned int cache_size)
+{
+    VertexCacheStats stats;
+    if (idx.empty())
+        return stats;
+
+    CacheSim cache(vertex_count, cache_size);
+    const size_t misses = CountMisses(idx, 0, idx.size(), cache);
+
+    std::vector<uint8_t> used(vertex_count, 0);
+    size_t referenced = 0;
+    for (unsigned int v : idx)
+    {
+        referenced += !used[v];
+        used[v] = 1;
+    }
+
+    stats.acmr = (float)misses / (float)(idx.size() / 3);
+    stats.atvr = (float)misses / (float)referenced;
+    return stats;
+}
+
+OptimizeReport OptimizeMesh(Mesh& mesh, const OptimizeOptions& options)
+{
+    OptimizeReport report;
+    const size_t vertex_count = mesh.vtx.size();
+    const uint32_t cache_size = std::max(options.cache_size, 3u);
+    report.vertices_before = report.vertices_after = vertex_count;
+    report.before = AnalyzeVertexCache(mesh.idx, vertex_count, cache_size);
+
+    std::vector<uint32_t> order, clusters;
+    Tipsify(mesh.idx, vertex_count, cache_size, order, clusters);
+
+    std::vector<unsigned int> reordered(mesh.idx.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        std::copy(mesh.idx.begin() + order[i] * 3, mesh.idx.begin() + order[i] * 3 + 3, reordered.begin() + i * 3);
+    mesh.idx.swap(reordered);
+
+    if (options.overdraw_threshold > 0.0f && !clusters.empty())
+    {
+        SplitClusters(mesh.idx, vertex_count, cache_size, options.overdraw_threshold, clusters);
+        SortClusters(mesh.idx, mesh.vtx, clusters);
+    }
+    report.clusters = clusters.size();
+
+    if (options.compact_vertices)
+    {
+        std::vector<uint32_t> remap(vertex_count, NONE);
+        std::vector<Vertex> vertices;
+        vertices.reserve(vertex_count);
+        for (unsigned int& v : mesh.idx)
+        {
+            if (remap[v] == NONE)
+            {
+                remap[v] = (uint32_t)vertices.size();
+                vertices.push_back(mesh.vtx[v]);
+            }
+            v = remap[v];
+        }
+        mesh.vtx.swap(vertices);
+        report.vertices_after = mesh.vtx.size();
+    }
+
+    report.after = AnalyzeVertexCache(mesh.idx, mesh.vtx.size(), cache_size);
+    return report;
+}
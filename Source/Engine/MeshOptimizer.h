@@ -0,0 +1,34 @@
+#pragma once
+#include "Model.h"
+#include <cstddef>
+#include <vector>
+
+// Post-transform cache behaviour of an index buffer under a FIFO cache of 'cache_size' entries.
+struct VertexCacheStats
+{
+	float acmr = 0.0f; // transformed vertices per triangle, 0.5 is the best a regular grid can do.
+	float atvr = 0.0f; // transformed vertices per referenced vertex, 1 means none is shaded twice.
+};
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& idx, size_t vertex_count, unsigned int cache_size = 16);
+
+struct OptimizeOptions
+{
+	unsigned int cache_size = 16;
+	float overdraw_threshold = 1.05f; // clusters may cost this much ACMR to sort front to back, 0 = keep Tipsify order.
+	bool compact_vertices = true;     // drop unused vertices and store the rest in first-use order.
+};
+
+struct OptimizeReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+	size_t vertices_before = 0;
+	size_t vertices_after = 0;
+	size_t clusters = 0;
+};
+
+// Tipsify (Sander et al. 2007) triangle order, then its clusters sorted outside-in to cut overdraw,
+// then vertices renumbered for fetch locality. Run on a copy of Model::GetMesh(): the model keeps
+// its index buffer in face order to patch it per collapse.
+OptimizeReport OptimizeMesh(Mesh& mesh, const OptimizeOptions& options = OptimizeOptions());
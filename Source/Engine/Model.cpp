@@ -1,617 +1,1703 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "Model.h"
+#include "Memory.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "Parallel.h"
+#include "ProgressiveMesh.h"
+#include "RadixSort.h"
+#include "Trace.h"
 #include <string>
 #include <array>
 #include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iterator>
-#include <unordered_map>
-#include <unordered_set>
+#include <memory>
 
-Model::Model(const char* file_name)
+namespace
 {
-    FILE* file = fopen(file_name, "r");
-    if (file == NULL)
+    // Progress reporting and cancellation shared by the strategies. Only the calling thread
+    // reports, at most once per percent of the budget.
+    class BudgetTracker
     {
-        printf("[Error] Fail trying to open the file: %s\n", file_name);
-        return;
+    public:
+        BudgetTracker(const SimplifyOptions& options, unsigned int budget)
+            : m_Options(options), m_Budget(budget), m_Step(std::max(1u, budget / 100)), m_Next(m_Step) {}
+
+        bool Cancelled() const { return m_Options.cancel && m_Options.cancel->load(std::memory_order_relaxed); }
+
+        void Advance(unsigned int done)
+        {
+            if (!m_Options.progress || done < m_Next)
+                return;
+            m_Options.progress((float)done / (float)m_Budget);
+            m_Next = done + m_Step;
+        }
+
+    private:
+        const SimplifyOptions& m_Options;
+        unsigned int m_Budget;
+        unsigned int m_Step;
+        unsigned int m_Next;
+    };
+
+    // Bijective 32-bit mix: priorities built from distinct halfedges never tie.
+    inline uint32_t Scramble(uint32_t x, uint32_t seed)
+    {
+        x ^= seed;
+        x *= 0x9E3779B1u; x ^= x >> 16;
+        x *= 0x85EBCA6Bu; x ^= x >> 13;
+        x *= 0xC2B2AE35u; x ^= x >> 16;
+        return x;
     }
 
-    std::vector<glm::vec3> temp_vertices;
-    std::vector<glm::vec3> temp_normals;
-    std::vector<glm::vec2> temp_uvs;
+    inline void AtomicMin(std::atomic<uint64_t>& value, uint64_t candidate)
+    {
+        uint64_t current = value.load(std::memory_order_relaxed);
+        while (candidate < current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {}
+    }
 
-    struct ObjTriplet { int vi, ti, ni; };
-    std::vector<ObjTriplet> tri_list;
-    tri_list.reserve(4096);
+    // Calls fn for every vertex of N[v1]. A collapse only writes faces with two corners in N[v1] and
+    // only moves the quadrics of N[v1], so collapses with disjoint N[v1] can run concurrently and
+    // keep each other's link condition. The fan must be closed, which the link condition ensures.
+    template <typename Fn>
+    void ForEachClaimedVertex(const HalfEdgeMesh& mesh, uint32_t halfedge, Fn&& fn)
+    {
+        fn(mesh.origin[halfedge]);
+        uint32_t current = halfedge;
+        do {
+            fn(mesh.Dest(current));
+            current = HalfEdgeMesh::Next(mesh.twin[current]);
+        } while (current != halfedge);
+    }
 
-    auto ResolveObjIndex = [](long idx, size_t count) -> int
+    // After CollapseTopology, calls fn with an outgoing halfedge of v2 and of every vertex of the
+    // old one-ring of v1: the only fans that changed. n4 is the v2 -> v4 halfedge.
+    template <typename Fn>
+    void ForEachChangedFan(const HalfEdgeMesh& mesh, uint32_t n2, uint32_t n4, Fn&& fn)
     {
-        if (idx > 0) return (int)(idx - 1);
-        if (idx < 0) return (int)((long)count + idx);
-        return -1;
-    };
+        fn(n2);
+        uint32_t current = n2;
+        bool changed = false;
+        do {
+            changed = changed || current == n4;
+            if (changed)
+                fn(mesh.twin[current]);
+            current = HalfEdgeMesh::Next(mesh.twin[current]);
+        } while (current != n2);
+        fn(mesh.twin[n2]);
+    }
 
-    auto ParseFaceVertexToken = [&](const char* token, ObjTriplet& out) -> bool
+    // Open-addressing map from an OBJ (vi, ti, ni) triplet to its vertex.
+    class TripletTable
     {
-        out.vi = -1; out.ti = -1; out.ni = -1;
-        char* end = nullptr;
-        long v = std::strtol(token, &end, 10);
-        if (end == token)
-            return false;
-        out.vi = ResolveObjIndex(v, temp_vertices.size());
+    public:
+        explicit TripletTable(size_t expected)
+        {
+            size_t capacity = 16;
+            while (capacity < expected * 2) capacity <<= 1;
+            m_Slots.assign(capacity, Slot{ { -1, -1, -1 }, 0 });
+        }
 
-        if (*end == '/')
+        // Returns the vertex stored for 't', or inserts 'vertex' and returns it.
+        uint32_t FindOrInsert(const ObjTriplet& t, uint32_t vertex)
         {
-            ++end;
-            if (*end != '/')
+            if ((m_Count + 1) * 2 > m_Slots.size())
+                Grow();
+
+            size_t mask = m_Slots.size() - 1;
+            for (size_t i = Hash(t) & mask;; i = (i + 1) & mask)
             {
-                long t = std::strtol(end, &end, 10);
-                out.ti = ResolveObjIndex(t, temp_uvs.size());
+                Slot& slot = m_Slots[i];
+                if (slot.key.vi < 0)
+                {
+                    slot.key = t;
+                    slot.vertex = vertex;
+                    ++m_Count;
+                    return vertex;
+                }
+                if (slot.key.vi == t.vi && slot.key.ti == t.ti && slot.key.ni == t.ni)
+                    return slot.vertex;
             }
-            if (*end == '/')
+        }
+
+        inline size_t Bytes() const { return Memory::Bytes(m_Slots); }
+
+    private:
+        struct Slot
+        {
+            ObjTriplet key;
+            uint32_t vertex;
+        };
+
+        static size_t Hash(const ObjTriplet& t)
+        {
+            uint64_t h = (uint64_t)(uint32_t)t.vi * 0x9E3779B97F4A7C15ull;
+            h ^= ((uint64_t)(uint32_t)t.ti + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+            h ^= ((uint64_t)(uint32_t)t.ni + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+            return (size_t)(h ^ (h >> 29));
+        }
+
+        void Grow()
+        {
+            QEM_TRACE_COUNT("triplet_rehashes", 1);
+            std::vector<Slot> old;
+            old.swap(m_Slots);
+            m_Slots.assign(old.size() * 2, Slot{ { -1, -1, -1 }, 0 });
+            size_t mask = m_Slots.size() - 1;
+            for (const Slot& slot : old)
             {
-                ++end;
-                long n = std::strtol(end, &end, 10);
-                out.ni = ResolveObjIndex(n, temp_normals.size());
+                if (slot.key.vi < 0)
+                    continue;
+                size_t i = Hash(slot.key) & mask;
+                while (m_Slots[i].key.vi >= 0) i = (i + 1) & mask;
+                m_Slots[i] = slot;
             }
         }
-        return (out.vi >= 0);
+
+    private:
+        std::vector<Slot> m_Slots;
+        size_t m_Count = 0;
     };
+}
 
-    char line[512];
-    while (fgets(line, sizeof(line), file))
+Model::Model(const char* file_name, const LoadOptions& options)
+{
+    QEM_TRACE_SCOPE("Model::Load");
+    const std::string cache_name = std::string(file_name) + ".qemcache";
+    MeshCacheKey cache_key;
+    const auto start = std::chrono::steady_clock::now();
+    auto phase_start = start;
+    auto Lap = [&phase_start]()
     {
-        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
-            continue;
+        const auto now = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(now - phase_start).count();
+        phase_start = now;
+        return seconds;
+    };
+
+    Memory::ResetPeak();
+    const bool use_cache = options.use_cache && ComputeMeshCacheKey(file_name, options, cache_key);
 
-        if (line[0] == 'v' && line[1] == ' ')
+    std::vector<uint32_t> twin;
+    if (use_cache && ReadMeshCache(cache_name.c_str(), cache_key, m_Mesh, m_Quadrics, twin, m_BoundaryEdges, m_NonManifoldEdges))
+    {
+        m_LoadTimings.from_cache = true;
+        m_LoadTimings.read = Lap();
+        EndMemoryPhase("read");
+        m_Topology.Reset(m_Mesh.idx.size() / 3);
+        m_Topology.origin.assign(m_Mesh.idx.begin(), m_Mesh.idx.end());
+        m_Topology.twin.swap(twin);
+        if (options.verbose)
         {
-            glm::vec3 v; sscanf(line + 2, "%f %f %f", &v.x, &v.y, &v.z);
-            temp_vertices.push_back(v);
+            PrintAnalysis(file_name);
+            printf("  > Loaded from cache:     %s\n", cache_name.c_str());
         }
-        else if (line[0] == 'v' && line[1] == 't')
+        BuildHeap();
+        m_LoadTimings.quadrics = Lap();
+        EndMemoryPhase("quadrics");
+        m_LoadTimings.total = std::chrono::duration<double>(phase_start - start).count();
+        return;
+    }
+
+    {
+        // Scoped: the OBJ arrays are dead once welded, the topology phases should not carry them.
+        ObjData obj;
+        if (!LoadObj(file_name, obj))
         {
-            glm::vec2 uv; sscanf(line + 3, "%f %f", &uv.x, &uv.y);
-            temp_uvs.push_back(uv);
+            printf("[Error] Fail trying to open the file: %s\n", file_name);
+            return;
         }
-        else if (line[0] == 'v' && line[1] == 'n')
+        m_LoadTimings.read = Lap();
+        NoteTransient("obj.positions", Memory::Bytes(obj.vertices));
+        NoteTransient("obj.attributes", Memory::Bytes(obj.normals) + Memory::Bytes(obj.uvs));
+        NoteTransient("obj.corners", Memory::Bytes(obj.corners));
+        EndMemoryPhase("read");
+
+        QEM_TRACE_SCOPE("Weld");
+        switch (options.weld)
         {
-            glm::vec3 n; sscanf(line + 3, "%f %f %f", &n.x, &n.y, &n.z);
-            temp_normals.push_back(n);
+        case WeldMode::Geometric: WeldPositions(obj, options.weld_eps); break;
+        case WeldMode::IndexTriplet: WeldIndices(obj, true); break;
+        case WeldMode::PositionIndex: WeldIndices(obj, false); break;
         }
-        else if (line[0] == 'f' && std::isspace((unsigned char)line[1]))
-        {
-            std::vector<ObjTriplet> face;
-            face.reserve(4);
-            char* p = line + 1;
-            while (*p)
-            {
-                while (*p && std::isspace((unsigned char)*p)) ++p;
-                if (!*p) break;
-                char* start = p;
-                while (*p && !std::isspace((unsigned char)*p)) ++p;
-                char saved = *p; *p = '\0';
-                ObjTriplet t;
-                if (ParseFaceVertexToken(start, t)) face.push_back(t);
-                *p = saved;
-            }
+    }
+    m_LoadTimings.weld = Lap();
+    EndMemoryPhase("weld");
 
-            // Triangulate
-            for (size_t i = 1; i + 1 < face.size(); ++i)
-            {
-                tri_list.push_back(face[0]);
-                tri_list.push_back(face[i]);
-                tri_list.push_back(face[i + 1]);
-            }
-        }
+    GenerateMeshData();
+    m_LoadTimings.topology = Lap();
+    EndMemoryPhase("topology");
+    if (options.verbose)
+        PrintAnalysis(file_name);
+    Lap();
+    {
+        QEM_TRACE_SCOPE("PrepareQEMData");
+        PrepareQEMData();
     }
+    m_LoadTimings.quadrics = Lap();
+    EndMemoryPhase("quadrics");
+
+    if (use_cache && !WriteMeshCache(cache_name.c_str(), cache_key, m_Mesh, m_Quadrics, m_Topology.twin, m_BoundaryEdges, m_NonManifoldEdges))
+        printf("[Warning] Fail trying to write the cache file: %s\n", cache_name.c_str());
+    m_LoadTimings.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-    fclose(file);
+Model::~Model() = default;
 
-    m_Mesh.vtx.clear();
-    m_Mesh.idx.clear();
-    m_Mesh.vtx.reserve(tri_list.size());
-    m_Mesh.idx.reserve(tri_list.size());
+void Model::BeginRecording()
+{
+    m_Log.reset(new CollapseLog());
+    m_Log->origin = m_Topology.origin;
+    m_Log->faces = m_Topology.live;
+}
 
-    constexpr float WELD_POS_EPS = 1e-4f;
+ProgressiveMesh Model::EndRecording()
+{
+    if (!m_Log)
+        return ProgressiveMesh();
 
-    struct CellKey
+    ProgressiveMesh pm(m_Mesh.vtx, *m_Log);
+    m_Log.reset();
+    CompactIfNeeded();
+    return pm;
+}
+
+void Model::PrintAnalysis(const char* file_name) const
+{
+    bool isClosed = (m_BoundaryEdges == 0);
+    bool isTwoManifold = (m_NonManifoldEdges == 0);
+
+    printf("--- Model Analysis: %s ---\n", file_name);
+    printf("  > Vertices (Unique Pos): %zu\n", m_Mesh.vtx.size());
+    printf("  > Triangles:             %zu\n", m_Mesh.idx.size() / 3);
+    printf("Topology Status:\n");
+    if (isClosed && isTwoManifold)
     {
-        int64_t x, y, z;
-        bool operator==(const CellKey& o) const { return x == o.x && y == o.y && z == o.z; }
-    };
+        printf("  [OK] CLOSED MANIFOLD (Watertight)\n");
+    }
+    else
+    {
+        printf("  [WARNING] Issues Found:\n");
+        if (m_BoundaryEdges > 0) printf("    - Open Edges (Holes): %u\n", m_BoundaryEdges);
+        if (m_NonManifoldEdges > 0) printf("    - Non-Manifold Edges: %u\n", m_NonManifoldEdges);
+    }
+    printf("--------------------------------\n");
+}
 
-    struct CellHasher
+void Model::WeldPositions(const ObjData& obj, float WELD_POS_EPS)
+{
+    // Same result as visiting every corner in order and reusing the first vertex created so far
+    // within WELD_POS_EPS, scanning the 27 neighbour cells in z, y, x order. Instead of a hash grid,
+    // the referenced positions are sorted by cell so each (z, y) row of three cells is one range.
+    constexpr size_t WELD_GRAIN = 4096;
+    constexpr uint32_t INVALID = 0xFFFFFFFFu;
+    constexpr uint32_t PENDING = 0xFFFFFFFEu;
+
+    const std::vector<ObjTriplet>& tri_list = obj.corners;
+
+    // Units are the referenced 'v' records, in the order their first corner appears.
+    std::vector<uint32_t> unit_of(obj.vertices.size(), INVALID);
+    std::vector<uint32_t> first_corner;
+    for (size_t c = 0; c < tri_list.size(); ++c)
     {
-        size_t operator()(const CellKey& k) const
+        uint32_t& unit = unit_of[tri_list[c].vi];
+        if (unit == INVALID)
         {
-            size_t h = (size_t)k.x * 73856093;
-            h ^= (size_t)k.y * 19349663;
-            h ^= (size_t)k.z * 83492791;
-            return h;
+            unit = (uint32_t)first_corner.size();
+            first_corner.push_back((uint32_t)c);
         }
+    }
+    const size_t unit_count = first_corner.size();
+
+    struct CellKey
+    {
+        int64_t x, y, z;
+        bool operator<(const CellKey& o) const { return z != o.z ? z < o.z : (y != o.y ? y < o.y : x < o.x); }
     };
 
+    auto Position = [&](uint32_t unit) -> const glm::vec3& { return obj.vertices[tri_list[first_corner[unit]].vi]; };
     auto GetCell = [&](glm::vec3 p) -> CellKey
     {
         return { (int64_t)(p.x / WELD_POS_EPS), (int64_t)(p.y / WELD_POS_EPS), (int64_t)(p.z / WELD_POS_EPS) };
     };
 
-    std::unordered_map<CellKey, std::vector<unsigned int>, CellHasher> grid;
+    std::vector<CellKey> cells(unit_count);
+    Parallel::For(unit_count, WELD_GRAIN, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t u = first; u < last; ++u)
+            cells[u] = GetCell(Position((uint32_t)u));
+    });
 
-    for (const ObjTriplet& t : tri_list)
+    CellKey lo = { INT64_MAX, INT64_MAX, INT64_MAX }, hi = { INT64_MIN, INT64_MIN, INT64_MIN };
+    for (const CellKey& k : cells)
     {
-        if (t.vi < 0)
-            continue;
+        lo = { std::min(lo.x, k.x), std::min(lo.y, k.y), std::min(lo.z, k.z) };
+        hi = { std::max(hi.x, k.x), std::max(hi.y, k.y), std::max(hi.z, k.z) };
+    }
 
-        Vertex cand;
-        cand.position = temp_vertices[t.vi];
+    auto Bits = [](int64_t lo, int64_t hi) -> uint32_t
+    {
+        uint64_t range = (uint64_t)hi - (uint64_t)lo;
+        uint32_t bits = 0;
+        while (bits < 64 && (range >> bits) != 0) ++bits;
+        return bits;
+    };
+    const uint32_t bx = unit_count ? Bits(lo.x, hi.x) : 0;
+    const uint32_t by = unit_count ? Bits(lo.y, hi.y) : 0;
+    const uint32_t bz = unit_count ? Bits(lo.z, hi.z) : 0;
+
+    // Stable sorts keep units of the same cell in creation order, which is the order they are probed.
+    std::vector<SortPair> sorted(unit_count);
+    auto FillKeys = [&](auto&& key)
+    {
+        Parallel::For(unit_count, WELD_GRAIN, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t i = first; i < last; ++i)
+                sorted[i].key = key(cells[sorted[i].value]);
+        });
+    };
+    for (uint32_t u = 0; u < (uint32_t)unit_count; ++u)
+        sorted[u].value = u;
 
-        bool hasUV = (t.ti >= 0);
-        bool hasN = (t.ni >= 0);
-        cand.uv = hasUV ? temp_uvs[t.ti] : glm::vec2(0.0f);
-        cand.normal = hasN ? temp_normals[t.ni] : glm::vec3(0.0f, 0.0f, 1.0f);
+    if (bx + by + bz <= 64)
+    {
+        FillKeys([&](const CellKey& k) { return ((uint64_t)(k.z - lo.z) << (bx + by)) | ((uint64_t)(k.y - lo.y) << bx) | (uint64_t)(k.x - lo.x); });
+        RadixSort(sorted);
+    }
+    else if (bx <= 32 && by <= 32 && bz <= 32)
+    {
+        FillKeys([&](const CellKey& k) { return ((uint64_t)(k.y - lo.y) << 32) | (uint64_t)(k.x - lo.x); });
+        RadixSort(sorted);
+        FillKeys([&](const CellKey& k) { return (uint64_t)(k.z - lo.z); });
+        RadixSort(sorted);
+    }
+    else
+    {
+        std::stable_sort(sorted.begin(), sorted.end(), [&](const SortPair& a, const SortPair& b) { return cells[a.value] < cells[b.value]; });
+    }
 
-        CellKey key = GetCell(cand.position);
-        int foundIdx = -1;
+    std::vector<CellKey> sorted_cells(unit_count);
+    Parallel::For(unit_count, WELD_GRAIN, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t i = first; i < last; ++i)
+            sorted_cells[i] = cells[sorted[i].value];
+    });
 
-        for (int dz = -1; dz <= 1 && foundIdx == -1; ++dz)
+    // First unit created before 'u', within WELD_POS_EPS and accepted by 'accept', in probe order.
+    auto FirstEarlier = [&](uint32_t u, auto&& accept) -> uint32_t
+    {
+        const CellKey key = cells[u];
+        const glm::vec3 p = Position(u);
+        for (int64_t dz = -1; dz <= 1; ++dz)
         {
-            for (int dy = -1; dy <= 1 && foundIdx == -1; ++dy)
+            for (int64_t dy = -1; dy <= 1; ++dy)
             {
-                for (int dx = -1; dx <= 1 && foundIdx == -1; ++dx)
+                CellKey row_lo = { key.x - 1, key.y + dy, key.z + dz };
+                CellKey row_hi = { key.x + 1, key.y + dy, key.z + dz };
+                size_t i = std::lower_bound(sorted_cells.begin(), sorted_cells.end(), row_lo) - sorted_cells.begin();
+                for (; i < unit_count && !(row_hi < sorted_cells[i]); ++i)
                 {
-                    CellKey neighbor = { key.x + dx, key.y + dy, key.z + dz };
-                    auto it = grid.find(neighbor);
-                    if (it != grid.end())
-                    {
-                        for (unsigned int existingIdx : it->second)
-                        {
-                            const Vertex& existing = m_Mesh.vtx[existingIdx];
+                    uint32_t w = sorted[i].value;
+                    if (w >= u || !accept(w))
+                        continue;
 
-                            float dx = std::abs(existing.position.x - cand.position.x);
-                            float dy = std::abs(existing.position.y - cand.position.y);
-                            float dz = std::abs(existing.position.z - cand.position.z);
-
-                            if (dx <= WELD_POS_EPS && dy <= WELD_POS_EPS && dz <= WELD_POS_EPS)
-                            {
-                                foundIdx = (int)existingIdx;
-                                break;
-                            }
-                        }
-                    }
+                    const glm::vec3& q = Position(w);
+                    if (std::abs(q.x - p.x) <= WELD_POS_EPS && std::abs(q.y - p.y) <= WELD_POS_EPS && std::abs(q.z - p.z) <= WELD_POS_EPS)
+                        return w;
                 }
             }
         }
+        return INVALID;
+    };
 
-        if (foundIdx != -1)
-        {
-            m_Mesh.idx.push_back((unsigned int)foundIdx);
-        }
-        else
+    std::vector<uint32_t> first_hit(unit_count);
+    Parallel::For(unit_count, WELD_GRAIN, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t u = first; u < last; ++u)
+            first_hit[u] = FirstEarlier((uint32_t)u, [](uint32_t) { return true; });
+    });
+
+    // A unit without earlier neighbours always creates a vertex, and a unit whose first neighbour is
+    // such a unit always reuses it. Only chains longer than that need the sequential replay.
+    std::vector<uint32_t> rep(unit_count);
+    Parallel::For(unit_count, WELD_GRAIN, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t u = first; u < last; ++u)
         {
-            unsigned int newIdx = (unsigned int)m_Mesh.vtx.size();
-            m_Mesh.vtx.push_back(cand);
-            m_Mesh.idx.push_back(newIdx);
-            grid[key].push_back(newIdx);
+            uint32_t hit = first_hit[u];
+            if (hit == INVALID) rep[u] = (uint32_t)u;
+            else if (first_hit[hit] == INVALID) rep[u] = hit;
+            else rep[u] = PENDING;
         }
-    }
+    });
 
-    std::unordered_map<uint64_t, int> edgeCounts;
-    for (size_t i = 0; i < m_Mesh.idx.size(); i += 3)
+    for (uint32_t u = 0; u < (uint32_t)unit_count; ++u)
     {
-        unsigned int idx[3] = { m_Mesh.idx[i], m_Mesh.idx[i + 1], m_Mesh.idx[i + 2] };
-        for (int j = 0; j < 3; ++j)
-        {
-            unsigned int a = idx[j];
-            unsigned int b = idx[(j + 1) % 3];
-            uint64_t minV = std::min(a, b);
-            uint64_t maxV = std::max(a, b);
-            edgeCounts[(minV << 32) | maxV]++;
-        }
-    }
+        if (rep[u] != PENDING)
+            continue;
 
-    int boundaryEdges = 0;
-    int nonManifoldEdges = 0;
+        uint32_t hit = FirstEarlier(u, [&](uint32_t w) { return rep[w] == w; });
+        rep[u] = (hit == INVALID) ? u : hit;
+    }
 
-    for (auto const& [edge, count] : edgeCounts)
+    std::vector<uint32_t> vertex_of(unit_count);
+    m_Mesh.vtx.clear();
+    for (uint32_t u = 0; u < (uint32_t)unit_count; ++u)
     {
-        if (count == 1) boundaryEdges++;
-        if (count > 2) nonManifoldEdges++;
-    }
+        if (rep[u] != u)
+            continue;
 
-    bool isClosed = (boundaryEdges == 0);
-    bool isTwoManifold = (nonManifoldEdges == 0);
+        const ObjTriplet& t = tri_list[first_corner[u]];
+        Vertex cand;
+        cand.position = obj.vertices[t.vi];
+        cand.uv = (t.ti >= 0) ? obj.uvs[t.ti] : glm::vec2(0.0f);
+        cand.normal = (t.ni >= 0) ? obj.normals[t.ni] : glm::vec3(0.0f, 0.0f, 1.0f);
+        vertex_of[u] = (uint32_t)m_Mesh.vtx.size();
+        m_Mesh.vtx.push_back(cand);
+    }
 
-    printf("--- Model Analysis: %s ---\n", file_name);
-    printf("  > Vertices (Unique Pos): %zu\n", m_Mesh.vtx.size());
-    printf("  > Triangles:             %zu\n", m_Mesh.idx.size() / 3);
-    printf("Topology Status:\n");
-    if (isClosed && isTwoManifold)
+    m_Mesh.idx.resize(tri_list.size());
+    Parallel::For(tri_list.size(), WELD_GRAIN, [&](size_t first, size_t last, size_t)
     {
-        printf("  [OK] CLOSED MANIFOLD (Watertight)\n");
-    }
-    else
+        for (size_t c = first; c < last; ++c)
+            m_Mesh.idx[c] = vertex_of[rep[unit_of[tri_list[c].vi]]];
+    });
+
+    NoteTransient("weld.cells", Memory::Bytes(cells) + Memory::Bytes(sorted_cells) + Memory::Bytes(sorted));
+    NoteTransient("weld.units", Memory::Bytes(unit_of) + Memory::Bytes(first_corner) + Memory::Bytes(first_hit) + Memory::Bytes(rep) + Memory::Bytes(vertex_of));
+}
+
+void Model::WeldIndices(const ObjData& obj, bool split_attributes)
+{
+    // The file's own indices are authoritative: a flat lookup per corner, no geometry involved.
+    constexpr uint32_t INVALID = 0xFFFFFFFFu;
+    const std::vector<ObjTriplet>& tri_list = obj.corners;
+
+    m_Mesh.vtx.clear();
+    m_Mesh.idx.resize(tri_list.size());
+
+    std::vector<uint32_t> vertex_of;
+    TripletTable table(split_attributes ? obj.vertices.size() : 0);
+    if (!split_attributes)
+        vertex_of.assign(obj.vertices.size(), INVALID);
+
+    for (size_t c = 0; c < tri_list.size(); ++c)
     {
-        printf("  [WARNING] Issues Found:\n");
-        if (boundaryEdges > 0) printf("    - Open Edges (Holes): %d\n", boundaryEdges);
-        if (nonManifoldEdges > 0) printf("    - Non-Manifold Edges: %d\n", nonManifoldEdges);
+        const ObjTriplet& t = tri_list[c];
+        uint32_t next = (uint32_t)m_Mesh.vtx.size();
+        uint32_t vertex = split_attributes ? table.FindOrInsert(t, next) : vertex_of[t.vi];
+        if (vertex == INVALID)
+            vertex = vertex_of[t.vi] = next;
+
+        if (vertex == next)
+        {
+            Vertex cand;
+            cand.position = obj.vertices[t.vi];
+            cand.uv = (t.ti >= 0) ? obj.uvs[t.ti] : glm::vec2(0.0f);
+            cand.normal = (t.ni >= 0) ? obj.normals[t.ni] : glm::vec3(0.0f, 0.0f, 1.0f);
+            m_Mesh.vtx.push_back(cand);
+        }
+        m_Mesh.idx[c] = vertex;
     }
-    printf("--------------------------------\n");
 
-    GenerateMeshData();
-    PrepareQEMData();
+    NoteTransient("weld.triplets", table.Bytes() + Memory::Bytes(vertex_of));
 }
 
 void Model::GenerateMeshData()
 {
+    QEM_TRACE_SCOPE("GenerateMeshData");
+    constexpr size_t TWIN_GRAIN = 1 << 16;
     const size_t count = m_Mesh.idx.size();
-    m_Faces.reserve(count / 3);
-    m_HalfEdges.reserve(count);
-    m_Keys.reserve(count);
+    m_Topology.Reset(count / 3);
+    m_Topology.origin.assign(m_Mesh.idx.begin(), m_Mesh.idx.end());
 
-    for (size_t i = 0; i < count; i += 3)
+    // Every halfedge keyed by its undirected edge: after a stable sort each edge is one run, in
+    // halfedge order, that gives both the twins and the boundary/non-manifold report.
+    std::vector<SortPair> edges(count);
+    Parallel::For(count, TWIN_GRAIN, [&](size_t first, size_t last, size_t)
     {
-        unsigned int idx1 = m_Mesh.idx[i + 0];
-        unsigned int idx2 = m_Mesh.idx[i + 1];
-        unsigned int idx3 = m_Mesh.idx[i + 2];
+        for (size_t h = first; h < last; ++h)
+        {
+            uint64_t u = m_Topology.origin[h];
+            uint64_t v = m_Topology.Dest((uint32_t)h);
+            edges[h] = { (std::min(u, v) << 32) | std::max(u, v), (uint32_t)h };
+        }
+    });
+    RadixSort(edges);
 
-        Vertex* v1 = &m_Mesh.vtx[idx1];
-        Vertex* v2 = &m_Mesh.vtx[idx2];
-        Vertex* v3 = &m_Mesh.vtx[idx3];
+    QEM_TRACE_SCOPE("TopologyAnalysis");
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(Parallel::WorkerCount(), count / TWIN_GRAIN));
+    std::vector<uint32_t> boundary(workers, 0), non_manifold(workers, 0);
+    Parallel::For(workers, 1, [&](size_t first_worker, size_t last_worker, size_t)
+    {
+        for (size_t w = first_worker; w < last_worker; ++w)
+        {
+            // Each worker owns the runs that start inside its range.
+            size_t i = count * w / workers;
+            size_t end = count * (w + 1) / workers;
+            while (i > 0 && i < count && edges[i].key == edges[i - 1].key) ++i;
 
-        HalfEdge* halfedge = new HalfEdge;
-        halfedge->origin = idx1;
-        halfedge->face = nullptr;
-        halfedge->twin = nullptr;
-        halfedge->cost = 0.0f;
+            while (i < end)
+            {
+                size_t run_end = i + 1;
+                while (run_end < count && edges[run_end].key == edges[i].key) ++run_end;
 
-        //next
-        halfedge->next = new HalfEdge;
-        halfedge->next->origin = idx2;
-        halfedge->next->twin = nullptr;
-        halfedge->next->cost = 0.0f;
-        halfedge->next->face = nullptr;
-        halfedge->next->next = new HalfEdge;
-        halfedge->next->next->origin = idx3;
-        halfedge->next->next->twin = nullptr;
-        halfedge->next->next->cost = 0.0f;
-        halfedge->next->next->face = nullptr;
-        halfedge->next->next->next = halfedge;
+                size_t run = run_end - i;
+                if (run == 1) ++boundary[w];
+                if (run > 2) ++non_manifold[w];
 
-        // prev
-        halfedge->prev = halfedge->next->next;
-        halfedge->next->prev = halfedge;
-        halfedge->next->next->prev = halfedge->next;
+                // Pair the first halfedge of each direction, as a first-come map would. Repeated
+                // directions (non-manifold or flipped faces) stay without twin and act as boundaries.
+                uint32_t forward = HalfEdgeMesh::INVALID, backward = HalfEdgeMesh::INVALID;
+                for (size_t j = i; j < run_end; ++j)
+                {
+                    uint32_t h = edges[j].value;
+                    uint32_t u = m_Topology.origin[h], v = m_Topology.Dest(h);
+                    if (u < v && forward == HalfEdgeMesh::INVALID) forward = h;
+                    if (u > v && backward == HalfEdgeMesh::INVALID) backward = h;
+                }
+                if (forward != HalfEdgeMesh::INVALID && backward != HalfEdgeMesh::INVALID)
+                {
+                    m_Topology.twin[forward] = backward;
+                    m_Topology.twin[backward] = forward;
+                }
+                i = run_end;
+            }
+        }
+    });
 
-        uint64_t e1_key = HalfEdgeKey(idx1, idx2);
-        uint64_t e2_key = HalfEdgeKey(idx2, idx3);
-        uint64_t e3_key = HalfEdgeKey(idx3, idx1);
+    m_BoundaryEdges = 0;
+    m_NonManifoldEdges = 0;
+    for (size_t w = 0; w < workers; ++w)
+    {
+        m_BoundaryEdges += boundary[w];
+        m_NonManifoldEdges += non_manifold[w];
+    }
+    NoteTransient("topology.edge_keys", Memory::Bytes(edges));
+}
 
-        // No es necesario hacer un swap por si se repiten los half/twin, porque no puede pasar.
-        // Es topolgicamente imposible en un 2-manifold orientado. (Si hacs CW o CCW, un halfedge de un tringulo queda hacia arriba y el otro halfedge del tringulo vecino queda hacia abajo).
-        if (m_HalfEdges.find(e1_key) == m_HalfEdges.end())
+void Model::PrepareQEMData()
+{
+    QEM_TRACE_SCOPE_TOTAL("PrepareQEMData");
+    if (!m_DirtyVertices.empty())
+    {
+        // The one-ring of every dirty vertex changed. Recompute: their quadrics changed too, so every
+        // halfedge leaving or entering them has a stale cost. Accumulate: only v2 (the first entry)
+        // has a new quadric, the rest only need their cached link condition dropped.
+        const bool recompute = m_QuadricUpdate == QuadricUpdate::Recompute;
+        if (recompute)
         {
-            m_HalfEdges[e1_key] = halfedge;
-            m_Keys.push_back(e1_key);
+            for (uint32_t outgoing : m_DirtyVertices)
+                ComputeQuadric(outgoing);
         }
 
-        if (m_HalfEdges.find(e2_key) == m_HalfEdges.end())
+        for (size_t i = 0; i < m_DirtyVertices.size(); ++i)
+            RefreshFan(m_DirtyVertices[i], recompute || i == 0);
+
+        m_DirtyVertices.clear();
+        return;
+    }
+
+    // If its first time computing Q matrices: every face plane once, then each vertex sums the
+    // planes of its faces. Corners sorted by vertex give every vertex a contiguous run, so the sum
+    // is a gather with no write conflicts between workers.
+    constexpr size_t QUADRIC_GRAIN = 1 << 14;
+    const size_t face_count = m_Topology.FaceCount();
+    const size_t corner_count = face_count * 3;
+
+    std::vector<Quadric> face_quadrics(face_count);
+    std::vector<SortPair> corners(corner_count);
+    Parallel::For(face_count, QUADRIC_GRAIN, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t face = first; face < last; ++face)
         {
-            m_HalfEdges[e2_key] = halfedge->next;
-            m_Keys.push_back(e2_key);
+            const uint32_t* idx = &m_Topology.origin[face * 3];
+            face_quadrics[face] = Quadric::FromTriangle(m_Mesh.vtx[idx[0]].position, m_Mesh.vtx[idx[1]].position, m_Mesh.vtx[idx[2]].position);
+            for (uint32_t k = 0; k < 3; ++k)
+                corners[face * 3 + k] = { idx[k], (uint32_t)face };
         }
+    });
+    RadixSort(corners);
 
-        if (m_HalfEdges.find(e3_key) == m_HalfEdges.end())
+    m_Quadrics.assign(m_Mesh.vtx.size(), Quadric::Zero());
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(Parallel::WorkerCount(), corner_count / QUADRIC_GRAIN));
+    Parallel::For(workers, 1, [&](size_t first_worker, size_t last_worker, size_t)
+    {
+        for (size_t w = first_worker; w < last_worker; ++w)
         {
-            m_HalfEdges[e3_key] = halfedge->next->next;
-            m_Keys.push_back(e3_key);
+            // Each worker owns the vertex runs that start inside its range.
+            size_t i = corner_count * w / workers;
+            size_t end = corner_count * (w + 1) / workers;
+            while (i > 0 && i < corner_count && corners[i].key == corners[i - 1].key) ++i;
+            for (; i < corner_count && (i < end || corners[i].key == corners[i - 1].key); ++i)
+                m_Quadrics[corners[i].key] += face_quadrics[corners[i].value]; //sum(K_p);
         }
+    });
+    NoteTransient("quadrics.face_planes", Memory::Bytes(face_quadrics));
+    NoteTransient("quadrics.corners", Memory::Bytes(corners));
+
+    BuildHeap();
+}
+
+void Model::BuildHeap()
+{
+    QEM_TRACE_SCOPE("BuildHeap");
+    const uint32_t halfedge_count = (uint32_t)m_Topology.HalfEdgeCount();
+    m_Heap.Reset(halfedge_count);
+    for (uint32_t face : m_Topology.live)
+    {
+        for (uint32_t h = face * 3; h < face * 3 + 3; ++h)
+            m_Heap.Append(h, EdgeCost(h));
+    }
+    m_Heap.Build();
+    m_HeapStale = false;
+    m_EdgeState.assign(halfedge_count, EdgeState::Unknown);
+}
+
+void Model::ComputeQuadric(uint32_t outgoing)
+{
+    uint32_t current_edge = outgoing;
+    Vertex& v1 = m_Mesh.vtx[m_Topology.origin[outgoing]];
+    Quadric& Q = m_Quadrics[m_Topology.origin[outgoing]];
+    Q = Quadric::Zero();
+
+    do {
+        uint32_t twin = m_Topology.twin[current_edge];
+        if (twin == HalfEdgeMesh::INVALID)
+            break;
+
+        uint32_t next = HalfEdgeMesh::Next(current_edge);
+        Vertex& v2 = m_Mesh.vtx[m_Topology.origin[next]];
+        Vertex& v3 = m_Mesh.vtx[m_Topology.origin[HalfEdgeMesh::Next(next)]];
+        Q += Quadric::FromTriangle(v1.position, v2.position, v3.position); //sum(K_p);
+        current_edge = HalfEdgeMesh::Next(twin);
+    } while (current_edge != outgoing);
+}
+
+float Model::EdgeCost(uint32_t halfedge) const
+{
+    // v2^T (Q1 + Q2) v2, evaluated per quadric since vTQv is linear in Q.
+    const glm::vec3& v = m_Mesh.vtx[m_Topology.Dest(halfedge)].position;
+    return (float)(m_Quadrics[m_Topology.origin[halfedge]].Evaluate(v) + m_Quadrics[m_Topology.Dest(halfedge)].Evaluate(v));
+}
+
+void Model::UpdateCost(uint32_t halfedge)
+{
+    QEM_TRACE_COUNT("heap_updates", 1);
+    m_Heap.Update(halfedge, EdgeCost(halfedge));
+}
+
+// Drops the cached link condition of every edge around the vertex. Edges that left the heap as
+// unsafe go back in since they may be collapsible now.
+void Model::RefreshFan(uint32_t outgoing, bool recost)
+{
+    uint32_t current_edge = outgoing;
+    do {
+        m_EdgeState[current_edge] = EdgeState::Unknown;
+        if (recost || !m_Heap.Contains(current_edge))
+            UpdateCost(current_edge);
 
-        uint64_t twin1_key = HalfEdgeKey(idx2, idx1);
-        uint64_t twin2_key = HalfEdgeKey(idx3, idx2);
-        uint64_t twin3_key = HalfEdgeKey(idx1, idx3);
+        uint32_t twin = m_Topology.twin[current_edge];
+        if (twin == HalfEdgeMesh::INVALID)
+            break;
+
+        m_EdgeState[twin] = EdgeState::Unknown;
+        if (recost || !m_Heap.Contains(twin))
+            UpdateCost(twin);
+        current_edge = HalfEdgeMesh::Next(twin);
+    } while (current_edge != outgoing);
+}
+
+bool Model::IsCollapseSafe(uint32_t halfedge)
+{
+    QEM_TRACE_SCOPE_TOTAL("IsCollapseSafe");
+    if (m_EdgeState[halfedge] != EdgeState::Unknown)
+        return m_EdgeState[halfedge] == EdgeState::Safe;
+
+    const bool safe = LinkCondition(halfedge);
+    const uint32_t twin = m_Topology.twin[halfedge];
+    const EdgeState state = safe ? EdgeState::Safe : EdgeState::Unsafe;
+    m_EdgeState[halfedge] = state;
+    if (twin != HalfEdgeMesh::INVALID)
+        m_EdgeState[twin] = state;
+    return safe;
+}
+
+// Link condition: v1 and v2 must share exactly the two opposite vertices. Reads only, so batch
+// workers call it concurrently. The one-ring of v1 goes to an inline buffer, a matched entry is
+// dropped so a repeated neighbour is not counted twice; rings past the buffer are searched in place
+// with the same result.
+bool Model::LinkCondition(uint32_t halfedge) const
+{
+    constexpr uint32_t RING_BUFFER = 32;
+    uint32_t ring[RING_BUFFER];
+    uint32_t ring_size = 0;
+
+    uint32_t currenth = halfedge;
+    do {
+        uint32_t twin = m_Topology.twin[currenth];
+        if (twin == HalfEdgeMesh::INVALID) return false; // Necesario para descartar non-manifold.
+        if (ring_size < RING_BUFFER) ring[ring_size] = m_Topology.origin[twin];
+        ++ring_size;
+        currenth = HalfEdgeMesh::Next(twin);
+    } while (currenth != halfedge);
+
+    const bool buffered = ring_size <= RING_BUFFER;
+    const uint32_t next = HalfEdgeMesh::Next(halfedge);
+    uint32_t shared = 0;
+    currenth = next;
+    do {
+        uint32_t twin = m_Topology.twin[currenth];
+        if (twin == HalfEdgeMesh::INVALID) return false; // Necesario para descartar non-manifold.
+        const uint32_t vertex = m_Topology.origin[twin];
 
-        if (m_HalfEdges.find(twin1_key) != m_HalfEdges.end())
+        bool found = false;
+        if (buffered)
         {
-            halfedge->twin = m_HalfEdges[twin1_key];
-            halfedge->twin->twin = halfedge;
+            uint32_t* it = std::find(ring, ring + ring_size, vertex);
+            if (it != ring + ring_size)
+            {
+                *it = ring[--ring_size];
+                found = true;
+            }
         }
-
-        if (m_HalfEdges.find(twin2_key) != m_HalfEdges.end())
+        else
         {
-            halfedge->next->twin = m_HalfEdges[twin2_key];
-            halfedge->next->twin->twin = halfedge->next;
+            // Dropping matched entries, without the buffer: the k-th occurrence of 'vertex' around v2
+            // matches only while v1 has more than k of them.
+            uint32_t earlier = 0, around_v1 = 0;
+            for (uint32_t h = next; h != currenth; h = HalfEdgeMesh::Next(m_Topology.twin[h]))
+                earlier += m_Topology.Dest(h) == vertex;
+            uint32_t fan = halfedge;
+            do {
+                around_v1 += m_Topology.Dest(fan) == vertex;
+                fan = HalfEdgeMesh::Next(m_Topology.twin[fan]);
+            } while (around_v1 <= earlier && fan != halfedge);
+            found = earlier < around_v1;
         }
 
-        if (m_HalfEdges.find(twin3_key) != m_HalfEdges.end())
+        if (found && ++shared > 2)
+            return false;
+        currenth = HalfEdgeMesh::Next(twin);
+    } while (currenth != next);
+
+    return shared == 2;
+}
+
+uint32_t Model::NextStamp()
+{
+    // Clearing is only needed when the vertex count changed or the counter wrapped around.
+    if (m_VertexStamp.size() != m_Mesh.vtx.size() || ++m_Stamp == 0)
+    {
+        m_VertexStamp.assign(m_Mesh.vtx.size(), 0);
+        m_Stamp = 1;
+    }
+    return m_Stamp;
+}
+
+void Model::NoteTransient(const char* name, size_t bytes)
+{
+    for (MemoryEntry& entry : m_Transients)
+    {
+        if (!std::strcmp(entry.name, name))
         {
-            halfedge->next->next->twin = m_HalfEdges[twin3_key];
-            halfedge->next->next->twin->twin = halfedge->next->next;
+            entry.bytes = std::max(entry.bytes, bytes);
+            return;
         }
+    }
+    m_Transients.push_back({ name, bytes });
+}
 
-        Face* face = new Face;
-        face->halfedge = halfedge;
-        m_Faces.push_back(face);
+void Model::EndMemoryPhase(const char* name)
+{
+    m_MemoryPhases.push_back({ name, Memory::HeapPeak(), Memory::HeapCurrent() });
+    Memory::ResetPeak();
+}
 
-        halfedge->face = face;
-        halfedge->next->face = face;
-        halfedge->next->next->face = face;
+MemoryReport Model::GetMemoryReport() const
+{
+    MemoryReport report;
+    report.structures = {
+        { "mesh.vertices", Memory::Bytes(m_Mesh.vtx) },
+        { "mesh.indices", Memory::Bytes(m_Mesh.idx) },
+        { "topology.halfedges", Memory::Bytes(m_Topology.origin) + Memory::Bytes(m_Topology.twin) },
+        { "topology.faces", Memory::Bytes(m_Topology.live) + Memory::Bytes(m_Topology.slot) },
+        { "quadrics", Memory::Bytes(m_Quadrics) },
+        { "heap", m_Heap.MemoryBytes() },
+        { "edge_state", Memory::Bytes(m_EdgeState) },
+        { "vertex_stamps", Memory::Bytes(m_VertexStamp) },
+        { "dirty_tracking", Memory::Bytes(m_DirtyVertices) + Memory::Bytes(m_CompactRemap) + Memory::Bytes(m_Moved) +
+            Memory::Bytes(m_DirtyTriangles) + Memory::Bytes(m_TriangleDirty) },
+    };
+    if (m_Log)
+    {
+        report.structures.push_back({ "collapse_log", Memory::Bytes(m_Log->origin) + Memory::Bytes(m_Log->faces) +
+            Memory::Bytes(m_Log->entries) + Memory::Bytes(m_Log->moved) });
     }
+    for (const MemoryEntry& entry : report.structures)
+        report.structure_bytes += entry.bytes;
+    report.transients = m_Transients;
+    report.phases = m_MemoryPhases;
+    return report;
 }
 
-void Model::PrepareQEMData()
+void Model::EdgeCollapse(uint32_t halfedge)
+{
+    QEM_TRACE_SCOPE_TOTAL("EdgeCollapse");
+    // halfedge: v1 -> v2 on face (v1, v2, v3), twin: v2 -> v1 on face (v2, v1, v4).
+    const std::vector<uint32_t>& twins = m_Topology.twin;
+    const uint32_t twin = twins[halfedge];
+    const uint32_t v1 = m_Topology.origin[halfedge];
+    const uint32_t v2 = m_Topology.Dest(halfedge);
+    const uint32_t stamp = NextStamp();
+
+    uint32_t currenth = halfedge;
+    do {
+        m_VertexStamp[m_Topology.Dest(currenth)] = stamp; // one-ring of v1, their fans are about to change.
+        currenth = HalfEdgeMesh::Next(twins[currenth]);
+    } while (currenth != halfedge);
+
+    if (!m_Log)
+        m_Moved.clear();
+    std::vector<uint32_t>& moved = m_Log ? m_Log->moved : m_Moved;
+    const size_t first_moved = moved.size();
+    const uint32_t n2 = CollapseTopology(halfedge, moved);
+    MarkCornersDirty(moved, first_moved);
+    if (m_Log)
+        m_Log->Add(v1, v2, HalfEdgeMesh::Face(halfedge), HalfEdgeMesh::Face(twin));
+    if (m_QuadricUpdate == QuadricUpdate::Accumulate)
+        m_Quadrics[v2] += m_Quadrics[v1];
+
+    // Walk the new fan of v2 to pick the dirty vertices, v2 goes first.
+    m_DirtyVertices.push_back(n2);
+    currenth = n2;
+    do {
+        if (m_VertexStamp[m_Topology.Dest(currenth)] == stamp)
+            m_DirtyVertices.push_back(twins[currenth]);
+        currenth = HalfEdgeMesh::Next(twins[currenth]);
+    } while (currenth != n2);
+
+    const uint32_t dead[2] = { HalfEdgeMesh::Face(halfedge), HalfEdgeMesh::Face(twin) };
+    for (uint32_t face : dead)
+    {
+        for (uint32_t h = face * 3; h < face * 3 + 3; ++h)
+            m_Heap.Remove(h);
+        RemoveFace(face);
+    }
+}
+
+// Moves the fan of v1 onto v2 and stitches the holes left by the two faces of the edge; the faces
+// stay in 'live' until RemoveFace. Returns n2, the old v1 -> v3, now leaving v2.
+uint32_t Model::CollapseTopology(uint32_t halfedge, std::vector<uint32_t>& moved)
 {
-    std::unordered_set<uint32_t> VisitedVtx;
-    if (!m_LastCollapseds.empty())
+    std::vector<uint32_t>& origin = m_Topology.origin;
+    std::vector<uint32_t>& twins = m_Topology.twin;
+    const uint32_t twin = twins[halfedge];
+    const uint32_t v2 = m_Topology.Dest(halfedge);
+
+    uint32_t currenth = HalfEdgeMesh::Next(twins[halfedge]);
+    while (currenth != halfedge)
     {
-        for (uint64_t key : m_LastCollapseds)
-        {
-            HalfEdge* collapsed_edge = m_HalfEdges[key];
-            HalfEdge* current_edge = collapsed_edge;
-            uint32_t idx1 = current_edge->origin;
-            Vertex& v1 = m_Mesh.vtx[idx1];
-            if (VisitedVtx.find(idx1) == VisitedVtx.end())
-            {
-                VisitedVtx.insert(idx1);
-                v1.Q = glm::mat4(0.0f);
-
-                do {
-                    if (current_edge->twin == nullptr)
-                        break;
-
-                    Vertex& v2 = m_Mesh.vtx[current_edge->next->origin];
-                    Vertex& v3 = m_Mesh.vtx[current_edge->next->next->origin];
-                    glm::vec3 np = glm::cross(v2.position - v1.position, v3.position - v1.position);
-                    glm::vec3 n = normalize(np);
-                    float d = -glm::dot(n, v1.position);
-                    glm::vec4 plane(n, d);
-                    v1.Q += glm::outerProduct(plane, plane); //sum(K_p);
-                    current_edge = current_edge->twin->next;
-                } while (current_edge != collapsed_edge);
-            }
+        origin[currenth] = v2;
+        m_Mesh.idx[m_Topology.slot[HalfEdgeMesh::Face(currenth)] * 3 + currenth % 3] = v2;
+        moved.push_back(currenth);
+        currenth = HalfEdgeMesh::Next(twins[currenth]);
+    }
+
+    const uint32_t n1 = twins[HalfEdgeMesh::Next(halfedge)]; // v3 -> v2
+    const uint32_t n2 = twins[HalfEdgeMesh::Prev(halfedge)]; // v1 -> v3, now v2 -> v3
+    const uint32_t n3 = twins[HalfEdgeMesh::Next(twin)];     // v4 -> v1, now ends at v2
+    const uint32_t n4 = twins[HalfEdgeMesh::Prev(twin)];     // v2 -> v4
+    twins[n1] = n2;
+    twins[n2] = n1;
+    twins[n3] = n4;
+    twins[n4] = n3;
+    return n2;
+}
+
+// Mirrors HalfEdgeMesh::RemoveFace on the index buffer: the last triangle fills the hole.
+void Model::RemoveFace(uint32_t face)
+{
+    const uint32_t pos = m_Topology.slot[face];
+    const uint32_t last = (uint32_t)m_Topology.LiveFaceCount() - 1;
+    if (pos != last)
+    {
+        std::copy(m_Mesh.idx.begin() + last * 3, m_Mesh.idx.begin() + last * 3 + 3, m_Mesh.idx.begin() + pos * 3);
+        MarkTriangleDirty(pos);
+    }
+    m_Mesh.idx.resize((size_t)last * 3);
+    m_Topology.RemoveFace(face);
+}
+
+void Model::MarkTriangleDirty(uint32_t triangle)
+{
+    if (m_TriangleDirty.size() <= triangle)
+        m_TriangleDirty.resize(m_Topology.FaceCount(), 0);
+    if (!m_TriangleDirty[triangle])
+    {
+        m_TriangleDirty[triangle] = 1;
+        m_DirtyTriangles.push_back(triangle);
+    }
+}
+
+// Before any RemoveFace of the same step, while the slots still are where the corners were written.
+void Model::MarkCornersDirty(const std::vector<uint32_t>& moved, size_t first)
+{
+    for (size_t i = first; i < moved.size(); ++i)
+        MarkTriangleDirty(m_Topology.slot[HalfEdgeMesh::Face(moved[i])]);
+}
+
+void Model::TakeDirtyRanges(std::vector<IndexRange>& ranges)
+{
+    ranges.clear();
+    std::sort(m_DirtyTriangles.begin(), m_DirtyTriangles.end());
+    const size_t triangle_count = m_Mesh.idx.size() / 3;
+    for (uint32_t triangle : m_DirtyTriangles)
+    {
+        m_TriangleDirty[triangle] = 0;
+        if (triangle >= triangle_count)
+            continue;
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == (size_t)triangle * 3)
+            ranges.back().count += 3;
+        else
+            ranges.push_back({ (size_t)triangle * 3, 3 });
+    }
+    m_DirtyTriangles.clear();
+}
+
+void Model::Simplify(unsigned int iterations)
+{
+    SimplifyOptions options;
+    options.max_collapses = iterations;
+    if (Simplify(options).stop == SimplifyStop::NoValidEdges)
+        printf("No more valid edges.\n");
+}
 
-            Vertex& v2 = m_Mesh.vtx[collapsed_edge->next->origin];
-            glm::vec4 v(v2.position, 1.0f);
-            collapsed_edge->cost = glm::dot(v, (v1.Q + v2.Q) * v);
-            if (collapsed_edge->twin != nullptr)
+SimplifyResult Model::Simplify(const SimplifyOptions& options)
+{
+    QEM_TRACE_SCOPE("Simplify");
+    Memory::ResetPeak();
+    const auto start = std::chrono::steady_clock::now();
+    SimplifyResult result;
+    result.initial_triangles = m_Topology.LiveFaceCount();
+
+    if (m_LiveVertices == 0)
+    {
+        const uint32_t stamp = NextStamp();
+        for (uint32_t face : m_Topology.live)
+        {
+            for (uint32_t h = face * 3; h < face * 3 + 3; ++h)
             {
-                v = glm::vec4(v1.position, 1.0f);
-                collapsed_edge->twin->cost = glm::dot(v, (v1.Q + v2.Q) * v);
+                if (m_VertexStamp[m_Topology.origin[h]] != stamp)
+                {
+                    m_VertexStamp[m_Topology.origin[h]] = stamp;
+                    ++m_LiveVertices;
+                }
             }
         }
-
-        m_LastCollapseds.clear();
-        return;
     }
 
-    // If its first time computing Q matrices:
-    for (const Face* face : m_Faces)
+    // Every collapse removes two faces: the link condition rejects edges on open fans.
+    size_t target = options.target_triangles;
+    if (options.ratio > 0.0f)
+        target = std::max(target, (size_t)std::ceil(options.ratio * (double)result.initial_triangles));
+    const size_t needed = result.initial_triangles > target ? (result.initial_triangles - target + 1) / 2 : 0;
+    const unsigned int budget = (unsigned int)std::min<size_t>(needed, options.max_collapses);
+
+    if (budget > 0)
     {
-        HalfEdge* current_edge = face->halfedge;
-        uint32_t idx1 = current_edge->origin;
-        Vertex& v1 = m_Mesh.vtx[idx1];
-        if (VisitedVtx.find(idx1) == VisitedVtx.end())
+        switch (options.strategy)
         {
-            VisitedVtx.insert(idx1);
-            v1.Q = glm::mat4(0.0f);
+        case SimplifyStrategy::Greedy: SimplifyGreedy(options, budget, result); break;
+        case SimplifyStrategy::Batch: SimplifyBatch(options, budget, result); break;
+        case SimplifyStrategy::MultipleChoice: SimplifyMultipleChoice(options, budget, result); break;
+        }
+    }
+    if (options.progress)
+        options.progress(budget ? (float)result.collapses / (float)budget : 1.0f);
+
+    m_LiveVertices -= result.collapses;
+    result.final_triangles = m_Topology.LiveFaceCount();
+    result.final_vertices = m_LiveVertices;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    QEM_TRACE_GAUGE("collapses_per_second", result.seconds > 0.0 ? (double)result.collapses / result.seconds : 0.0);
+    EndMemoryPhase("simplify");
+    QEM_TRACE_SAMPLE();
+    return result;
+}
 
-            do {
-                if (current_edge->twin == nullptr)
-                    break;
+LodChain Model::SimplifyLods(const std::vector<LodRequest>& lods, const SimplifyOptions& options)
+{
+    LodChain chain;
+    chain.levels.reserve(lods.size());
+    const size_t initial = m_Topology.LiveFaceCount();
+    std::vector<size_t> targets(lods.size());
+    std::vector<size_t> pending(lods.size());
+    for (size_t i = 0; i < lods.size(); ++i)
+    {
+        targets[i] = lods[i].ratio > 0.0f ? (size_t)std::ceil(lods[i].ratio * (double)initial) : 0;
+        pending[i] = i;
+    }
 
-                Vertex& v2 = m_Mesh.vtx[current_edge->next->origin];
-                Vertex& v3 = m_Mesh.vtx[current_edge->next->next->origin];
-                glm::vec3 np = glm::cross(v2.position - v1.position, v3.position - v1.position);
-                glm::vec3 n = normalize(np);
-                float d = -glm::dot(n, v1.position);
-                glm::vec4 plane(n, d);
-                v1.Q += glm::outerProduct(plane, plane); //sum(K_p);
-                current_edge = current_edge->twin->next;
-            } while (current_edge != face->halfedge);
+    // Each step runs to the nearest limit of any pending request: the largest triangle target or
+    // the smallest error bound. Every request met when it stops is snapshotted there, so levels come
+    // in the order they are reached whatever the order of 'lods'.
+    SimplifyOptions step = options;
+    step.ratio = 0.0f;
+    step.max_collapses = 0xFFFFFFFFu;
+    float error = 0.0f;
+    size_t unsaved = 0; // collapses since the last level.
+    while (!pending.empty())
+    {
+        step.target_triangles = 0;
+        step.max_error = FLT_MAX;
+        for (size_t i : pending)
+        {
+            step.target_triangles = (unsigned int)std::max<size_t>(step.target_triangles, targets[i]);
+            step.max_error = std::min(step.max_error, lods[i].max_error);
         }
-
-        current_edge = face->halfedge->next;
-        uint32_t idx2 = current_edge->origin;
-        Vertex& v2 = m_Mesh.vtx[idx2];
-        if (VisitedVtx.find(idx2) == VisitedVtx.end())
+        if (options.progress)
         {
-            VisitedVtx.insert(idx2);
-            v2.Q = glm::mat4(0.0f);
-
-            do {
-                if (current_edge->twin == nullptr)
-                    break;
+            const float reached = (float)(lods.size() - pending.size());
+            step.progress = [&](float done) { options.progress((reached + done) / (float)lods.size()); };
+        }
 
-                Vertex& v3 = m_Mesh.vtx[current_edge->next->origin];
-                Vertex& v4 = m_Mesh.vtx[current_edge->next->next->origin];
-                glm::vec3 np = glm::cross(v3.position - v2.position, v4.position - v2.position);
-                glm::vec3 n = normalize(np);
-                float d = -glm::dot(n, v2.position);
-                glm::vec4 plane(n, d);
-                v2.Q += glm::outerProduct(plane, plane); //sum(K_p);
-                current_edge = current_edge->twin->next;
-            } while (current_edge != face->halfedge->next);
+        const SimplifyResult result = Simplify(step);
+        error = std::max(error, result.max_error);
+        unsaved += result.collapses;
+        const size_t live = m_Topology.LiveFaceCount();
+        size_t request = lods.size();
+        size_t kept = 0;
+        for (size_t i : pending)
+        {
+            const bool met = live <= targets[i] || result.stop == SimplifyStop::NoValidEdges ||
+                (result.stop == SimplifyStop::MaxError && lods[i].max_error <= step.max_error);
+            if (met)
+                request = std::min(request, i);
+            else
+                pending[kept++] = i;
         }
+        pending.resize(kept);
 
-        glm::vec4 v(v2.position, 1.0f);
-        face->halfedge->cost = glm::dot(v, (v1.Q + v2.Q) * v);
-        if (face->halfedge->twin != nullptr)
+        // Met without a collapse since the last level: they share it.
+        if (request < lods.size() && (unsaved > 0 || chain.levels.empty()))
         {
-            v = glm::vec4(v1.position, 1.0f);
-            face->halfedge->twin->cost = glm::dot(v, (v1.Q + v2.Q) * v);
+            chain.levels.push_back({ m_Mesh.idx, 0, error, request });
+            unsaved = 0;
         }
+        if (result.stop == SimplifyStop::Cancelled)
+            break;
+    }
+
+    // Collapses only remove vertices, so each vertex is used by every level up to the coarsest that
+    // uses it. Sorting by that level, coarsest first, makes every level a prefix.
+    constexpr uint32_t UNUSED = 0xFFFFFFFFu;
+    const size_t level_count = chain.levels.size();
+    std::vector<uint32_t> coarsest(m_Mesh.vtx.size(), UNUSED);
+    for (size_t i = 0; i < level_count; ++i)
+        for (unsigned int v : chain.levels[i].indices)
+            coarsest[v] = (uint32_t)i;
+
+    std::vector<size_t> first(level_count + 1, 0);
+    for (uint32_t level : coarsest)
+        if (level != UNUSED) ++first[level_count - level];
+    for (size_t i = 1; i <= level_count; ++i)
+        first[i] += first[i - 1];
+    for (size_t i = 0; i < level_count; ++i)
+        chain.levels[i].vertex_count = first[level_count - i];
+
+    std::vector<uint32_t> remap(m_Mesh.vtx.size(), UNUSED);
+    chain.vertices.resize(first[level_count]);
+    for (uint32_t v = 0; v < (uint32_t)m_Mesh.vtx.size(); ++v)
+    {
+        if (coarsest[v] == UNUSED)
+            continue;
+        const size_t at = first[level_count - 1 - coarsest[v]]++;
+        remap[v] = (uint32_t)at;
+        chain.vertices[at] = m_Mesh.vtx[v];
     }
+    for (LodChain::Level& level : chain.levels)
+        for (unsigned int& v : level.indices)
+            v = remap[v];
+    return chain;
 }
 
-bool Model::IsCollapseSafe(HalfEdge* halfedge)
+void Model::SimplifyGreedy(const SimplifyOptions& options, unsigned int budget, SimplifyResult& result)
 {
-    std::unordered_set<uint32_t> s1;
-    std::unordered_set<uint32_t> s2;
+    if (m_HeapStale)
+        BuildHeap();
 
-    HalfEdge* currenth = halfedge;
-    do {
-        if (currenth == nullptr || currenth->twin == nullptr) return false; // Necesario para descartar non-manifold.
-        s1.insert(currenth->twin->origin);
-        currenth = currenth->twin->next;
-    } while (currenth != halfedge);
+    BudgetTracker tracker(options, budget);
+    while (result.collapses < budget)
+    {
+        if (tracker.Cancelled())
+        {
+            result.stop = SimplifyStop::Cancelled;
+            return;
+        }
 
-    currenth = halfedge->next;
-    
-    do {
-        if (currenth == nullptr || currenth->twin == nullptr) return false; // Necesario para descartar non-manifold.
-        s2.insert(currenth->twin->origin);
-        currenth = currenth->twin->next;
-    } while (currenth != halfedge->next);
+        uint32_t best_he = HalfEdgeMesh::INVALID;
+        float best_cost = 0.0f;
 
-    std::vector<uint32_t> v1(s1.begin(), s1.end());
-    std::vector<uint32_t> v2(s2.begin(), s2.end());
+        // Unsafe edges leave the heap until a collapse in their neighbourhood re-keys them.
+        while (!m_Heap.Empty() && m_Heap.TopCost() <= options.max_error)
+        {
+            best_cost = m_Heap.TopCost();
+            uint32_t he = m_Heap.Pop();
+            QEM_TRACE_COUNT("heap_pops", 1);
+            if (IsCollapseSafe(he))
+            {
+                best_he = he;
+                break;
+            }
+            QEM_TRACE_COUNT("rejected_candidates", 1);
+        }
 
-    std::sort(v1.begin(), v1.end());
-    std::sort(v2.begin(), v2.end());
+        if (best_he == HalfEdgeMesh::INVALID)
+        {
+            result.stop = m_Heap.Empty() ? SimplifyStop::NoValidEdges : SimplifyStop::MaxError;
+            return;
+        }
 
-    std::vector<uint32_t> I;
-    std::set_intersection(v1.begin(), v1.end(), v2.begin(), v2.end(), std::back_inserter(I));
+        EdgeCollapse(best_he);
+        PrepareQEMData();
+        result.max_error = std::max(result.max_error, best_cost);
+        tracker.Advance(++result.collapses);
+        QEM_TRACE_COUNT("collapses", 1);
+        if ((result.collapses & 0xFFF) == 0)
+            QEM_TRACE_SAMPLE();
 
-    return I.size() == 2;
+        CompactIfNeeded();
+    }
 }
 
-void Model::EdgeCollapse(HalfEdge* halfedge)
+// Halfedge ids must stay stable while recording, the log refers to them.
+bool Model::CompactIfNeeded()
 {
-    HalfEdge* twin = halfedge->twin;
-    HalfEdge* currenth = halfedge;
-    uint32_t v1 = halfedge->origin;
-    uint32_t v2 = halfedge->next->origin;
-    uint64_t k1 = HalfEdgeKey(halfedge->origin, halfedge->next->origin);
-    uint64_t k2 = HalfEdgeKey(halfedge->next->origin, halfedge->next->next->origin);
-    uint64_t k3 = HalfEdgeKey(halfedge->next->next->origin, halfedge->origin);
-    uint64_t k4 = HalfEdgeKey(twin->origin, twin->next->origin);
-    uint64_t k5 = HalfEdgeKey(twin->next->origin, twin->next->next->origin);
-    uint64_t k6 = HalfEdgeKey(twin->next->next->origin, twin->origin);
+    if (m_Log || !m_Topology.CompactIfNeeded(m_CompactRemap))
+        return false;
 
-    HalfEdge* n1 = halfedge->next->twin;
-    HalfEdge* n2 = twin->prev->twin;
+    if (!m_HeapStale)
+    {
+        m_Heap.Remap(m_CompactRemap, m_Topology.HalfEdgeCount());
+        std::vector<EdgeState> states(m_Topology.HalfEdgeCount());
+        for (size_t h = 0; h < m_CompactRemap.size(); ++h)
+            if (m_CompactRemap[h] != HalfEdgeMesh::INVALID)
+                states[m_CompactRemap[h]] = m_EdgeState[h];
+        m_EdgeState.swap(states);
+    }
+    return true;
+}
 
-    uint64_t n1_key = HalfEdgeKey(n1->origin, n1->next->origin);
-    uint64_t n2_key = HalfEdgeKey(n2->origin, n2->next->origin);
+// Luby-style rounds: every live halfedge cheaper than a cost quantile and passing the link
+// condition is a candidate with a random priority drawn from the seed. A candidate claims N[v1],
+// the closed one-ring of v1, with an atomic min and wins when it holds every claim. N[v1] is
+// enough: v2 is in it, the collapse rewrites only faces around v1, whose corners are all in N[v1],
+// and the twins across v2-v3 and v2-v4, edges between vertices of N[v1]. Winners with disjoint
+// N[v1] therefore never touch the same face, and the set does not depend on thread timing.
+// Winners collapse concurrently; the live list, quadric refresh and compaction follow in fixed
+// order, so a seed always gives the same mesh whatever the worker count.
+void Model::SimplifyBatch(const SimplifyOptions& options, unsigned int budget, SimplifyResult& result)
+{
+    constexpr float BATCH_COST_QUANTILE = 0.25f;
+    constexpr size_t BATCH_SAMPLES = 1 << 12;
+    constexpr size_t BATCH_GRAIN = 1 << 12;
+    constexpr uint64_t UNCLAIMED = ~0ull;
+    constexpr uint64_t TAKEN = 0;
+    constexpr uint8_t PENDING = 0, WON = 1, LOST = 2;
 
-    std::vector<HalfEdge*> to_delete = { m_HalfEdges[k1], m_HalfEdges[k2], m_HalfEdges[k3], m_HalfEdges[k4], m_HalfEdges[k5], m_HalfEdges[k6] };
-    do {
-        uint64_t current_key = HalfEdgeKey(currenth->origin, currenth->next->origin);
-        uint64_t current_twin_key = HalfEdgeKey(currenth->twin->origin, currenth->origin);
+    m_HeapStale = true; // collapses below leave the heap and the edge states behind.
 
-        m_HalfEdges.erase(current_key);
-        auto it = std::find(m_Keys.begin(), m_Keys.end(), current_key);
-        m_Keys.erase(it);
+    struct Candidate
+    {
+        uint64_t priority;
+        float cost;
+        uint32_t halfedge;
+    };
 
-        m_HalfEdges.erase(current_twin_key);
-        it = std::find(m_Keys.begin(), m_Keys.end(), current_twin_key);
-        m_Keys.erase(it);
+    const size_t vertex_count = m_Mesh.vtx.size();
+    std::unique_ptr<std::atomic<uint64_t>[]> claims(new std::atomic<uint64_t>[vertex_count]);
+    Parallel::For(vertex_count, BATCH_GRAIN * 16, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t v = first; v < last; ++v)
+            claims[v].store(UNCLAIMED, std::memory_order_relaxed);
+    });
+
+    // One snapshot of the worker count sizes the per-worker buffers and every For that indexes them.
+    const size_t workers = Parallel::WorkerCount();
+    std::vector<std::vector<Candidate>> worker_candidates(workers);
+    std::vector<CollapseLog> worker_logs(workers); // entries only while recording.
+    std::vector<Candidate> candidates;
+    std::vector<uint32_t> active;
+    std::vector<uint8_t> outcome;
+    std::vector<uint32_t> winners;
+    std::vector<uint32_t> dead_faces;
+    std::vector<uint32_t> stitched;
+    std::vector<float> samples;
+    bool unbounded = false; // last resort round with every safe edge as candidate.
+
+    BudgetTracker tracker(options, budget);
+    for (uint32_t round = 0; result.collapses < budget; ++round)
+    {
+        if (tracker.Cancelled())
+        {
+            result.stop = SimplifyStop::Cancelled;
+            break;
+        }
 
-        if (currenth != halfedge)
+        QEM_TRACE_SCOPE("BatchRound");
+        // Cost threshold from an evenly spaced sample of the collapsible halfedges.
+        const std::vector<uint32_t>& live = m_Topology.live;
+        float threshold = options.max_error;
+        if (!unbounded)
         {
-            uint64_t new_key = HalfEdgeKey(v2, currenth->twin->origin);
-            if (m_HalfEdges.find(new_key) == m_HalfEdges.end())
+            samples.clear();
+            const size_t stride = std::max<size_t>(1, live.size() * 3 / BATCH_SAMPLES);
+            for (size_t i = 0; i < live.size() * 3; i += stride)
             {
-                m_HalfEdges.emplace(new_key, currenth);
-                m_Keys.push_back(new_key);
+                uint32_t h = live[i / 3] * 3 + (uint32_t)(i % 3);
+                if (LinkCondition(h))
+                    samples.push_back(EdgeCost(h));
             }
-            else if (new_key != n1_key && new_key != n2_key)
+            if (samples.empty())
             {
-                m_HalfEdges[new_key] = currenth;
+                unbounded = true;
+                continue;
             }
-            m_LastCollapseds.push_back(new_key);
+            std::nth_element(samples.begin(), samples.begin() + (size_t)((samples.size() - 1) * BATCH_COST_QUANTILE), samples.end());
+            threshold = std::min(threshold, samples[(size_t)((samples.size() - 1) * BATCH_COST_QUANTILE)]);
+        }
 
-            // new twin key
-            new_key = HalfEdgeKey(currenth->twin->origin, v2);
-            if (m_HalfEdges.find(new_key) == m_HalfEdges.end())
+        const uint32_t round_seed = options.seed + round * 0x632BE5ABu;
+        for (std::vector<Candidate>& local : worker_candidates)
+            local.clear();
+        Parallel::For(live.size(), BATCH_GRAIN, workers, [&](size_t first, size_t last, size_t worker)
+        {
+            std::vector<Candidate>& local = worker_candidates[worker];
+            for (size_t i = first; i < last; ++i)
             {
-                m_HalfEdges.emplace(new_key, currenth->twin);
-                m_Keys.push_back(new_key);
+                for (uint32_t h = live[i] * 3; h < live[i] * 3 + 3; ++h)
+                {
+                    const float cost = EdgeCost(h);
+                    if (!(cost <= threshold))
+                        continue;
+                    if (!LinkCondition(h))
+                    {
+                        QEM_TRACE_COUNT("rejected_candidates", 1);
+                        continue;
+                    }
+
+                    const uint64_t priority = ((uint64_t)(Scramble(h, round_seed) | 1u) << 32) | h; // never TAKEN.
+                    local.push_back({ priority, cost, h });
+                }
             }
-            else if (new_key != n1_key && new_key != n2_key)
+        });
+
+        candidates.clear();
+        for (std::vector<Candidate>& local : worker_candidates)
+            candidates.insert(candidates.end(), local.begin(), local.end());
+        QEM_TRACE_COUNT("batch_scanned", live.size() * 3);
+        QEM_TRACE_COUNT("batch_candidates", candidates.size());
+
+        // Luby passes: every undecided candidate bids its priority on its claims. The ones holding
+        // all of them win and mark them TAKEN, which rules out every candidate overlapping them.
+        // The lowest bid always wins, so each pass decides at least one candidate.
+        active.resize(candidates.size());
+        for (uint32_t i = 0; i < (uint32_t)candidates.size(); ++i)
+            active[i] = i;
+        winners.clear();
+        while (!active.empty())
+        {
+            outcome.assign(active.size(), PENDING);
+            Parallel::For(active.size(), BATCH_GRAIN, [&](size_t first, size_t last, size_t)
+            {
+                for (size_t i = first; i < last; ++i)
+                {
+                    const Candidate& candidate = candidates[active[i]];
+                    ForEachClaimedVertex(m_Topology, candidate.halfedge, [&](uint32_t v) { AtomicMin(claims[v], candidate.priority); });
+                }
+            });
+            Parallel::For(active.size(), BATCH_GRAIN, [&](size_t first, size_t last, size_t)
             {
-                m_HalfEdges[new_key] = currenth->twin;
+                for (size_t i = first; i < last; ++i)
+                {
+                    const Candidate& candidate = candidates[active[i]];
+                    bool owner = true, blocked = false;
+                    ForEachClaimedVertex(m_Topology, candidate.halfedge, [&](uint32_t v)
+                    {
+                        const uint64_t claim = claims[v].load(std::memory_order_relaxed);
+                        owner = owner && claim == candidate.priority;
+                        blocked = blocked || claim == TAKEN;
+                    });
+                    outcome[i] = owner ? WON : (blocked ? LOST : PENDING);
+                }
+            });
+            // Winners mark their claims TAKEN, the others release theirs in the same pass. A release
+            // only replaces a bid, never TAKEN, so the order of the two does not matter.
+            Parallel::For(active.size(), BATCH_GRAIN, [&](size_t first, size_t last, size_t)
+            {
+                for (size_t i = first; i < last; ++i)
+                {
+                    const bool won = outcome[i] == WON;
+                    ForEachClaimedVertex(m_Topology, candidates[active[i]].halfedge, [&](uint32_t v)
+                    {
+                        uint64_t claim = claims[v].load(std::memory_order_relaxed);
+                        if (won)
+                            claims[v].store(TAKEN, std::memory_order_relaxed);
+                        else if (claim != TAKEN && claim != UNCLAIMED)
+                            claims[v].compare_exchange_strong(claim, UNCLAIMED, std::memory_order_relaxed);
+                    });
+                }
+            });
+
+            size_t pending = 0;
+            for (size_t i = 0; i < active.size(); ++i)
+            {
+                if (outcome[i] == WON) winners.push_back(active[i]);
+                else if (outcome[i] == PENDING) active[pending++] = active[i];
             }
+            active.resize(pending);
+        }
+
+        // Claims are released before the topology moves, the walks need the old fans.
+        Parallel::For(winners.size(), BATCH_GRAIN, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t i = first; i < last; ++i)
+                ForEachClaimedVertex(m_Topology, candidates[winners[i]].halfedge, [&](uint32_t v) { claims[v].store(UNCLAIMED, std::memory_order_relaxed); });
+        });
 
-            m_LastCollapseds.push_back(new_key);
-            currenth->origin = v2;
+        if (winners.empty())
+        {
+            if (unbounded)
+            {
+                result.stop = options.max_error < FLT_MAX ? SimplifyStop::MaxError : SimplifyStop::NoValidEdges;
+                break;
+            }
+            unbounded = true;
+            continue;
         }
+        unbounded = false;
 
-        currenth = currenth->twin->next;
+        const unsigned int remaining = budget - result.collapses;
+        if (winners.size() > remaining)
+        {
+            std::sort(winners.begin(), winners.end(), [&](uint32_t a, uint32_t b)
+            {
+                return candidates[a].cost < candidates[b].cost || (candidates[a].cost == candidates[b].cost && candidates[a].halfedge < candidates[b].halfedge);
+            });
+            winners.resize(remaining);
+        }
+        for (uint32_t& winner : winners)
+        {
+            result.max_error = std::max(result.max_error, candidates[winner].cost);
+            winner = candidates[winner].halfedge;
+        }
+        std::sort(winners.begin(), winners.end());
+        result.collapses += (unsigned int)winners.size();
+        QEM_TRACE_COUNT("collapses", winners.size());
 
-    } while (currenth != halfedge);
+        dead_faces.clear();
+        stitched.clear();
+        for (uint32_t h : winners)
+        {
+            const uint32_t twin = m_Topology.twin[h];
+            dead_faces.push_back(HalfEdgeMesh::Face(h));
+            dead_faces.push_back(HalfEdgeMesh::Face(twin));
+            stitched.push_back(m_Topology.twin[HalfEdgeMesh::Prev(twin)]); // n4
+        }
 
-    halfedge->next->twin->twin = halfedge->prev->twin;
-    halfedge->prev->twin->twin = halfedge->next->twin;
+        // Winners have disjoint N[v1], so each one rewrites only its own neighbourhood. Accumulate
+        // touches only v2 of its winner, Recompute waits until every fan is final.
+        const bool recompute = m_QuadricUpdate == QuadricUpdate::Recompute;
+        Parallel::For(winners.size(), BATCH_GRAIN / 16, workers, [&](size_t first, size_t last, size_t worker)
+        {
+            CollapseLog& log = worker_logs[worker];
+            for (size_t i = first; i < last; ++i)
+            {
+                const uint32_t v1 = m_Topology.origin[winners[i]];
+                const uint32_t v2 = m_Topology.Dest(winners[i]);
+                winners[i] = CollapseTopology(winners[i], log.moved); // now n2.
+                if (m_Log)
+                    log.Add(v1, v2, dead_faces[i * 2], dead_faces[i * 2 + 1]);
+                if (!recompute)
+                    m_Quadrics[v2] += m_Quadrics[v1];
+            }
+        });
 
-    twin->next->twin->twin = twin->prev->twin;
-    twin->prev->twin->twin = twin->next->twin;
+        // Ranges are in worker order, so the log keeps the winners sorted.
+        for (CollapseLog& log : worker_logs)
+        {
+            MarkCornersDirty(log.moved, 0);
+            if (m_Log)
+                m_Log->Append(log);
+            log.entries.clear();
+            log.moved.clear();
+        }
 
-    auto it = std::find(m_Faces.begin(), m_Faces.end(), halfedge->face);
-    m_Faces.erase(it);
-    delete halfedge->face;
+        for (uint32_t face : dead_faces)
+            RemoveFace(face);
 
-    it = std::find(m_Faces.begin(), m_Faces.end(), twin->face);
-    m_Faces.erase(it);
-    delete twin->face;
+        if (recompute)
+        {
+            Parallel::For(winners.size(), BATCH_GRAIN / 16, [&](size_t first, size_t last, size_t)
+            {
+                for (size_t i = first; i < last; ++i)
+                    ForEachChangedFan(m_Topology, winners[i], stitched[i], [&](uint32_t outgoing) { ComputeQuadric(outgoing); });
+            });
+        }
 
-    for (size_t i = 0; i < to_delete.size(); ++i)
-    {
-        delete to_delete[i];
+        CompactIfNeeded();
+        tracker.Advance(result.collapses);
+        QEM_TRACE_SAMPLE();
     }
+
+    size_t candidate_bytes = Memory::Bytes(candidates);
+    for (const std::vector<Candidate>& local : worker_candidates)
+        candidate_bytes += Memory::Bytes(local);
+    NoteTransient("batch.candidates", candidate_bytes);
+    NoteTransient("batch.claims", vertex_count * sizeof(std::atomic<uint64_t>));
 }
 
-void Model::Simplify(unsigned int iterations)
+// Wu-Kobbelt multiple-choice decimation: no heap, every step samples a few random halfedges and
+// collapses the cheapest one that passes the link condition. Each pass cuts the mesh in slabs along
+// its longest axis. A vertex is interior when its whole one-ring lies in its slab; a slab only
+// collapses edges between interior vertices, and every face such a collapse reads or writes has
+// its three corners in the slab, so slabs run on separate workers without locks. Boundaries move
+// by half a slab on every other pass so no edge stays frozen.
+void Model::SimplifyMultipleChoice(const SimplifyOptions& options, unsigned int budget, SimplifyResult& result)
 {
-    while (iterations--)
-    {
-        float minimal = std::numeric_limits<float>::infinity();
-        HalfEdge* best_he = nullptr;
+    constexpr size_t MC_PASS_FRACTION = 8;     // a pass collapses at most 1/8 of the live faces.
+    constexpr size_t MC_SLAB_FACES = 1 << 12;  // smaller slabs leave too few interior edges.
+    constexpr unsigned int MC_MAX_CHOICES = 16;
+    constexpr unsigned int MC_MAX_MISSES = 64; // consecutive failed steps before a slab gives up.
+    constexpr size_t MC_GRAIN = 1 << 14;
+
+    m_HeapStale = true;
+    const unsigned int choices = std::min(std::max(options.choices, 1u), MC_MAX_CHOICES);
 
-        for (auto& pair : m_HalfEdges)
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (const Vertex& v : m_Mesh.vtx)
+    {
+        lo = glm::min(lo, v.position);
+        hi = glm::max(hi, v.position);
+    }
+    const glm::vec3 extent = hi - lo;
+    const int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    const size_t vertex_count = m_Mesh.vtx.size();
+    std::unique_ptr<std::atomic<uint8_t>[]> interior(new std::atomic<uint8_t>[vertex_count]);
+    std::vector<uint8_t> dead;
+    std::vector<SortPair> slab_faces;
+    std::vector<std::vector<uint32_t>> slab_dead, slab_dirty;
+    std::vector<CollapseLog> slab_logs;
+    std::vector<float> slab_error;
+    uint32_t idle_passes = 0;
+
+    BudgetTracker tracker(options, budget);
+    for (uint32_t pass = 0; result.collapses < budget && idle_passes < 2; ++pass)
+    {
+        if (tracker.Cancelled())
         {
-            HalfEdge* he = pair.second;
+            result.stop = SimplifyStop::Cancelled;
+            break;
+        }
 
-            // No-valid halfedge
-            //if (!he || !he->next)
-                //continue;
+        QEM_TRACE_SCOPE("MCPass");
+        const std::vector<uint32_t>& live = m_Topology.live;
+        const uint32_t slabs = (uint32_t)std::max<size_t>(1, std::min<size_t>(Parallel::WorkerCount(), live.size() / MC_SLAB_FACES));
+        const float scale = extent[axis] > 0.0f ? (float)slabs / extent[axis] : 0.0f;
+        const float offset = (pass & 1) ? 0.5f : 0.0f;
+        const uint32_t slab_count = slabs + 1; // the shifted cut adds one.
+        auto SlabOf = [&](uint32_t v) -> uint32_t
+        {
+            float t = (m_Mesh.vtx[v].position[axis] - lo[axis]) * scale + offset;
+            return std::min((uint32_t)std::max(t, 0.0f), slabs);
+        };
 
-            //const glm::vec3& a = m_Mesh.vtx[he->origin].position;
-            //const glm::vec3& b = m_Mesh.vtx[he->next->origin].position;
-            //const glm::vec3 d = b - a;
-            //const float dist2 = glm::dot(d, d);
+        Parallel::For(vertex_count, MC_GRAIN, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t v = first; v < last; ++v)
+                interior[v].store(1, std::memory_order_relaxed);
+        });
+        Parallel::For(live.size(), MC_GRAIN, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const uint32_t* corner = &m_Topology.origin[live[i] * 3];
+                const uint32_t slab = SlabOf(corner[0]);
+                if (SlabOf(corner[1]) != slab || SlabOf(corner[2]) != slab)
+                {
+                    for (uint32_t k = 0; k < 3; ++k)
+                        interior[corner[k]].store(0, std::memory_order_relaxed);
+                }
+            }
+        });
 
-            //if (dist2 < minimal)
-            if (he->cost < minimal)
+        // Faces with three interior corners, grouped by slab. Collapses inside a slab keep them so.
+        slab_faces.resize(live.size());
+        Parallel::For(live.size(), MC_GRAIN, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const uint32_t* corner = &m_Topology.origin[live[i] * 3];
+                bool inside = true;
+                for (uint32_t k = 0; k < 3; ++k)
+                    inside = inside && interior[corner[k]].load(std::memory_order_relaxed);
+                slab_faces[i] = { inside ? (uint64_t)SlabOf(corner[0]) : (uint64_t)slab_count, live[i] };
+            }
+        });
+        RadixSort(slab_faces);
+
+        std::vector<size_t> slab_begin(slab_count + 1, 0);
+        for (const SortPair& face : slab_faces)
+            if (face.key < slab_count) ++slab_begin[face.key + 1];
+        for (uint32_t slab = 0; slab < slab_count; ++slab)
+            slab_begin[slab + 1] += slab_begin[slab];
+
+        const size_t candidate_faces = slab_begin[slab_count];
+        const size_t target = std::min<size_t>(budget - result.collapses, std::max<size_t>(1, live.size() / MC_PASS_FRACTION));
+        dead.assign(m_Topology.FaceCount(), 0);
+        slab_dead.resize(slab_count);
+        slab_dirty.resize(slab_count);
+        slab_logs.resize(slab_count);
+        slab_error.assign(slab_count, 0.0f);
+
+        const bool recompute = m_QuadricUpdate == QuadricUpdate::Recompute;
+        Parallel::For(slab_count, 1, [&](size_t first_slab, size_t last_slab, size_t)
+        {
+            for (size_t slab = first_slab; slab < last_slab; ++slab)
             {
-                if (IsCollapseSafe(he))
+                std::vector<uint32_t>& local_dead = slab_dead[slab];
+                std::vector<uint32_t>& local_dirty = slab_dirty[slab];
+                local_dead.clear();
+                local_dirty.clear();
+
+                const size_t begin = slab_begin[slab], size = slab_begin[slab + 1] - begin;
+                if (size == 0 || candidate_faces == 0)
+                    continue;
+
+                // Quotas from prefix sums add up to exactly 'target'.
+                size_t quota = target * (begin + size) / candidate_faces - target * begin / candidate_faces;
+                const uint32_t slab_seed = Scramble((uint32_t)slab, options.seed + pass * 0x632BE5ABu);
+                uint32_t counter = 0;
+                unsigned int misses = 0;
+                while (quota > 0 && misses < MC_MAX_MISSES && !tracker.Cancelled())
                 {
-                    //minimal = dist2;
-                    minimal = he->cost;
-                    best_he = he;
+                    uint32_t sample[MC_MAX_CHOICES];
+                    float cost[MC_MAX_CHOICES];
+                    unsigned int count = 0;
+                    QEM_TRACE_COUNT("mc_samples", choices);
+                    for (unsigned int c = 0; c < choices; ++c)
+                    {
+                        const uint32_t r = Scramble(counter++, slab_seed);
+                        const uint32_t face = slab_faces[begin + r % size].value;
+                        if (dead[face])
+                            continue;
+
+                        // 16 high bits give the corner a bias under 2^-15. Insertion keeps the
+                        // samples sorted by cost.
+                        const uint32_t h = face * 3 + (r >> 16) % 3;
+                        const float c_cost = EdgeCost(h);
+                        if (c_cost > options.max_error)
+                            continue;
+                        unsigned int at = count++;
+                        for (; at > 0 && cost[at - 1] > c_cost; --at)
+                        {
+                            sample[at] = sample[at - 1];
+                            cost[at] = cost[at - 1];
+                        }
+                        sample[at] = h;
+                        cost[at] = c_cost;
+                    }
+
+                    uint32_t best = HalfEdgeMesh::INVALID;
+                    float best_cost = 0.0f;
+                    for (unsigned int c = 0; c < count && best == HalfEdgeMesh::INVALID; ++c)
+                    {
+                        if (LinkCondition(sample[c]))
+                        {
+                            best = sample[c];
+                            best_cost = cost[c];
+                        }
+                        else
+                            QEM_TRACE_COUNT("rejected_candidates", 1);
+                    }
+
+                    if (best == HalfEdgeMesh::INVALID)
+                    {
+                        ++misses;
+                        continue;
+                    }
+                    misses = 0;
+                    --quota;
+                    slab_error[slab] = std::max(slab_error[slab], best_cost);
+
+                    const uint32_t v1 = m_Topology.origin[best];
+                    const uint32_t v2 = m_Topology.Dest(best);
+                    const uint32_t twin = m_Topology.twin[best];
+                    const uint32_t n4 = m_Topology.twin[HalfEdgeMesh::Prev(twin)];
+                    const uint32_t n2 = CollapseTopology(best, slab_logs[slab].moved);
+                    if (m_Log)
+                        slab_logs[slab].Add(v1, v2, HalfEdgeMesh::Face(best), HalfEdgeMesh::Face(twin));
+                    dead[HalfEdgeMesh::Face(best)] = dead[HalfEdgeMesh::Face(twin)] = 1;
+                    local_dead.push_back(HalfEdgeMesh::Face(best));
+                    local_dead.push_back(HalfEdgeMesh::Face(twin));
+
+                    // Fans outside the slab may still be moving, so recomputed quadrics wait for the
+                    // end of the pass; later samples in this pass see the stale ones.
+                    if (recompute)
+                        ForEachChangedFan(m_Topology, n2, n4, [&](uint32_t outgoing) { local_dirty.push_back(outgoing); });
+                    else
+                        m_Quadrics[v2] += m_Quadrics[v1];
                 }
             }
-        }
+        });
 
-        if (!best_he)
+        for (CollapseLog& log : slab_logs)
         {
-            printf("No more valid edges.\n");
-            break;
+            MarkCornersDirty(log.moved, 0);
+            if (m_Log)
+                m_Log->Append(log);
+            log.entries.clear();
+            log.moved.clear();
         }
 
-        EdgeCollapse(best_he);
-        PrepareQEMData();
-    }
+        size_t collapsed = 0;
+        for (uint32_t slab = 0; slab < slab_count; ++slab)
+        {
+            for (uint32_t face : slab_dead[slab])
+                RemoveFace(face);
+            collapsed += slab_dead[slab].size() / 2;
+            result.max_error = std::max(result.max_error, slab_error[slab]);
+        }
 
-    m_Mesh.idx.clear();
-    m_Mesh.idx.resize(0);
-    m_Mesh.idx.reserve(m_Faces.size() * 3);
+        // A dirty halfedge may have died later in the pass; the collapse that killed it marked its
+        // vertex again with a live one.
+        if (recompute)
+        {
+            Parallel::For(slab_count, 1, [&](size_t first_slab, size_t last_slab, size_t)
+            {
+                for (size_t slab = first_slab; slab < last_slab; ++slab)
+                    for (uint32_t outgoing : slab_dirty[slab])
+                        if (m_Topology.IsAlive(HalfEdgeMesh::Face(outgoing))) ComputeQuadric(outgoing);
+            });
+        }
 
-    for (Face* face : m_Faces)
-    {
-        m_Mesh.idx.push_back(face->halfedge->origin);
-        m_Mesh.idx.push_back(face->halfedge->next->origin);
-        m_Mesh.idx.push_back(face->halfedge->next->next->origin);
+        result.collapses += (unsigned int)collapsed;
+        QEM_TRACE_COUNT("collapses", collapsed);
+        idle_passes = collapsed ? 0 : idle_passes + 1;
+        CompactIfNeeded();
+        tracker.Advance(result.collapses);
+        QEM_TRACE_SAMPLE();
     }
+
+    if (idle_passes >= 2)
+        result.stop = options.max_error < FLT_MAX ? SimplifyStop::MaxError : SimplifyStop::NoValidEdges;
+    NoteTransient("mc.slab_faces", Memory::Bytes(slab_faces) + Memory::Bytes(dead));
+    NoteTransient("mc.interior", vertex_count * sizeof(std::atomic<uint8_t>));
 }
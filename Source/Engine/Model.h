@@ -1,31 +1,46 @@
-#include <unordered_map>
+#pragma once
 #include "../ThirdParty/glm/glm.hpp"
+#include "EdgeHeap.h"
+#include "HalfEdgeMesh.h"
+#include "Quadric.h"
+#include <atomic>
+#include <cfloat>
+#include <functional>
+#include <memory>
 #include <vector>
 
-struct Face;
-struct Vertex;
+struct ObjData;
+struct CollapseLog;
+class ProgressiveMesh;
 
-struct HalfEdge
+struct Vertex
 {
-	uint32_t origin;
-	Face* face;
-	HalfEdge* next;
-	HalfEdge* prev;
-	HalfEdge* twin;
-	float cost;
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
 };
 
-struct Face
+// How corners of the OBJ become mesh vertices.
+enum class WeldMode
 {
-	HalfEdge* halfedge;
+	Geometric,     // merge positions closer than WELD_POS_EPS, repairs exporters that duplicate 'v' per corner.
+	IndexTriplet,  // trust the file: one vertex per distinct (vi, ti, ni).
+	PositionIndex, // one vertex per 'v' record, enough for position-only simplification.
 };
 
-struct Vertex
+// How the quadrics around a collapse are refreshed.
+enum class QuadricUpdate
 {
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 uv;
-	glm::mat4 Q; // sum(K_p)
+	Recompute,  // rebuild every touched vertex from the planes of its current fan.
+	Accumulate, // Garland-Heckbert: the surviving vertex gets Q1 + Q2, nothing else changes. O(1).
+};
+
+struct LoadOptions
+{
+	WeldMode weld = WeldMode::Geometric;
+	float weld_eps = 1e-4f; // WELD_POS_EPS
+	bool use_cache = false; // read and keep a preprocessed '<file>.qemcache' next to the source; tools opt in.
+	bool verbose = true;    // print the analysis and where the mesh came from; errors always print.
 };
 
 struct Mesh
@@ -34,30 +49,199 @@ struct Mesh
 	std::vector<unsigned int> idx;
 };
 
+// [first, first + count) of Mesh::idx.
+struct IndexRange
+{
+	size_t first;
+	size_t count;
+};
+
+enum class SimplifyStrategy
+{
+	Greedy,         // global heap, always the cheapest collapse.
+	Batch,          // parallel rounds of independent low-cost collapses, deterministic per seed.
+	MultipleChoice, // best of 'choices' random edges per step, no queue.
+};
+
+// Every limit that is set is honoured; simplification stops at the first one reached.
+struct SimplifyOptions
+{
+	unsigned int target_triangles = 0;           // 0 = no triangle target.
+	float ratio = 0.0f;                          // target as a fraction of the triangles at the call, 0 = none.
+	float max_error = FLT_MAX;                   // never apply a collapse whose vTQv is above this.
+	unsigned int max_collapses = 0xFFFFFFFFu;
+	SimplifyStrategy strategy = SimplifyStrategy::Greedy;
+	uint32_t seed = 0;                           // Batch and MultipleChoice.
+	unsigned int choices = 8;                    // MultipleChoice.
+	std::function<void(float)> progress;         // fraction of the collapse budget done, called on the calling thread.
+	const std::atomic<bool>* cancel = nullptr;   // polled between collapses, rounds or passes.
+};
+
+enum class SimplifyStop
+{
+	Budget,       // reached the triangle target or max_collapses.
+	MaxError,     // the cheapest remaining collapse is above max_error.
+	NoValidEdges, // every remaining edge fails the link condition.
+	Cancelled,
+};
+
+struct SimplifyResult
+{
+	SimplifyStop stop = SimplifyStop::Budget;
+	unsigned int collapses = 0;
+	size_t initial_triangles = 0;
+	size_t final_triangles = 0;
+	size_t final_vertices = 0;
+	float max_error = 0.0f; // largest vTQv among the applied collapses.
+	double seconds = 0.0;
+};
+
+// Wall time of each phase of the constructor, in seconds. A cache hit only reads and builds the heap.
+struct LoadTimings
+{
+	bool from_cache = false;
+	double read = 0.0;     // OBJ parse or cache read.
+	double weld = 0.0;
+	double topology = 0.0; // GenerateMeshData: halfedges, twins and edge counts.
+	double quadrics = 0.0; // PrepareQEMData: initial quadrics, costs and heap.
+	double total = 0.0;
+};
+
+struct MemoryEntry
+{
+	const char* name;
+	size_t bytes;
+};
+
+struct MemoryPhase
+{
+	const char* name;
+	size_t peak;     // process heap high-water during the phase.
+	size_t retained; // process heap when it ended.
+};
+
+// Heap use of a model. Structure sizes are container capacities; phases need the counting hooks
+// of MemoryHooks.cpp (0 without them) and see every thread of the process, so with several models
+// in flight they bound, not isolate, the phases of this one.
+struct MemoryReport
+{
+	std::vector<MemoryEntry> structures; // held by the model now.
+	std::vector<MemoryEntry> transients; // largest size each temporary of a phase reached.
+	std::vector<MemoryPhase> phases;     // load phases, then one per Simplify call.
+	size_t structure_bytes = 0;
+};
+
+// One level of SimplifyLods, reached when either limit is.
+struct LodRequest
+{
+	float ratio = 0.0f;        // of the triangles when SimplifyLods starts, 0 = none.
+	float max_error = FLT_MAX;
+};
+
+// All levels index the same vertices. Level i uses the first levels[i].vertex_count of them, so a
+// coarser level uses a prefix of the vertices of any finer one.
+struct LodChain
+{
+	struct Level
+	{
+		std::vector<unsigned int> indices;
+		size_t vertex_count = 0;
+		float max_error = 0.0f; // largest vTQv applied up to this level.
+		size_t request = 0;     // first of the requests reached here, as an index into 'lods'.
+	};
+
+	std::vector<Vertex> vertices;
+	std::vector<Level> levels;
+};
+
+// Cached result of the link condition, reset to Unknown whenever a one-ring around the edge changes.
+enum class EdgeState : uint8_t
+{
+	Unknown,
+	Safe,
+	Unsafe,
+};
+
 class Model
 {
 public:
-	Model(const char* file_name);
+	Model(const char* file_name, const LoadOptions& options = LoadOptions());
+	~Model();
 
 public:
 	void Simplify(unsigned int iterations);
+	SimplifyResult Simplify(const SimplifyOptions& options);
+
+	// One simplification that snapshots a level as soon as a request's ratio or max_error is reached,
+	// so levels come in the order they are reached; the model is left at the last one. Requests
+	// reached at the same point share one level. A cancelled run returns the levels reached so far.
+	// Only strategy, seed, choices, progress and cancel of 'options' apply.
+	LodChain SimplifyLods(const std::vector<LodRequest>& lods, const SimplifyOptions& options = SimplifyOptions());
+
+	// Every collapse between the two calls becomes a record of the returned progressive mesh.
+	void BeginRecording();
+	ProgressiveMesh EndRecording();
+	inline void SetQuadricUpdate(QuadricUpdate update) { m_QuadricUpdate = update; }
 
 public:
+	// The index buffer is patched in place by every collapse: moved corners are rewritten and the
+	// two dead triangles are swap-removed, so it only shrinks and is always the live faces.
 	inline const Mesh& GetMesh() const { return m_Mesh; }
+	inline const LoadTimings& GetLoadTimings() const { return m_LoadTimings; }
+	MemoryReport GetMemoryReport() const;
+
+	// Triangles rewritten since the last call, sorted and merged, all below the current idx.size().
+	void TakeDirtyRanges(std::vector<IndexRange>& ranges);
 
 private:
+	friend class ModelBench; // Source/Tools/Benchmark.cpp times the private steps one by one.
+	friend class ModelTest;  // Source/Tests/Tests.cpp checks them one by one.
+
+	void WeldPositions(const ObjData& obj, float WELD_POS_EPS);
+	void WeldIndices(const ObjData& obj, bool split_attributes);
+	void PrintAnalysis(const char* file_name) const;
 	void GenerateMeshData();
 	void PrepareQEMData(); // compute error metric 'vTQv' for candidate pairs.
-	void EdgeCollapse(HalfEdge* halfedge);
-	bool IsCollapseSafe(HalfEdge* halfedge);
-
-private:
-	inline uint64_t HalfEdgeKey(uint32_t u, uint32_t v) { return (uint64_t(u) << 32) | uint64_t(v); }
+	void BuildHeap();
+	void ComputeQuadric(uint32_t outgoing);
+	float EdgeCost(uint32_t halfedge) const;
+	void UpdateCost(uint32_t halfedge);
+	void RefreshFan(uint32_t outgoing, bool recost);
+	void EdgeCollapse(uint32_t halfedge);
+	uint32_t CollapseTopology(uint32_t halfedge, std::vector<uint32_t>& moved);
+	void RemoveFace(uint32_t face);
+	void MarkTriangleDirty(uint32_t triangle);
+	void MarkCornersDirty(const std::vector<uint32_t>& moved, size_t first);
+	bool CompactIfNeeded();
+	bool IsCollapseSafe(uint32_t halfedge);
+	bool LinkCondition(uint32_t halfedge) const;
+	void SimplifyGreedy(const SimplifyOptions& options, unsigned int budget, SimplifyResult& result);
+	void SimplifyBatch(const SimplifyOptions& options, unsigned int budget, SimplifyResult& result);
+	void SimplifyMultipleChoice(const SimplifyOptions& options, unsigned int budget, SimplifyResult& result);
+	uint32_t NextStamp();
+	void NoteTransient(const char* name, size_t bytes);
+	void EndMemoryPhase(const char* name);
 
 private:
 	Mesh m_Mesh;
-	std::unordered_map<uint64_t, HalfEdge*> m_HalfEdges;
-	std::vector<Face*> m_Faces;
-	std::vector<uint64_t> m_Keys;
-	std::vector<uint64_t> m_LastCollapseds;
+	std::vector<Quadric> m_Quadrics; // per vertex, sum(K_p)
+	HalfEdgeMesh m_Topology;
+	std::vector<uint32_t> m_DirtyVertices; // one outgoing halfedge per vertex whose quadric changed.
+	EdgeHeap m_Heap;
+	std::vector<uint32_t> m_CompactRemap;
+	std::vector<uint32_t> m_Moved;           // scratch for the halfedges a greedy collapse re-origins.
+	std::vector<uint32_t> m_DirtyTriangles;  // positions in m_Mesh.idx / 3, each once.
+	std::vector<uint8_t> m_TriangleDirty;
+	std::vector<EdgeState> m_EdgeState;  // per halfedge, cached link condition.
+	std::vector<uint32_t> m_VertexStamp; // visited marks, a vertex is marked when it holds the current stamp.
+	uint32_t m_Stamp = 0;
+	QuadricUpdate m_QuadricUpdate = QuadricUpdate::Recompute;
+	std::unique_ptr<CollapseLog> m_Log; // set while recording.
+	size_t m_LiveVertices = 0;
+	bool m_HeapStale = false; // set by SimplifyBatch, the heap and edge states are rebuilt on demand.
+	LoadTimings m_LoadTimings;
+	std::vector<MemoryEntry> m_Transients;
+	std::vector<MemoryPhase> m_MemoryPhases;
+	uint32_t m_BoundaryEdges = 0;
+	uint32_t m_NonManifoldEdges = 0;
 };
@@ -0,0 +1,285 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+    constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    struct ObjCounts
+    {
+        size_t vertices = 0;
+        size_t uvs = 0;
+        size_t normals = 0;
+        size_t corners = 0;
+    };
+
+    enum class ObjRecord { None, Vertex, UV, Normal, Face };
+
+    inline bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline const char* SkipBlanks(const char* p, const char* end)
+    {
+        while (p < end && IsBlank(*p)) ++p;
+        return p;
+    }
+
+    inline const char* SkipToken(const char* p, const char* end)
+    {
+        while (p < end && !IsBlank(*p)) ++p;
+        return p;
+    }
+
+    inline const char* LineEnd(const char* p, const char* end)
+    {
+        const char* eol = (const char*)std::memchr(p, '\n', (size_t)(end - p));
+        return eol ? eol : end;
+    }
+
+    inline ObjRecord Classify(const char* p, const char* eol)
+    {
+        if (eol - p < 2)
+            return ObjRecord::None;
+
+        if (p[0] == 'v')
+        {
+            if (IsBlank(p[1])) return ObjRecord::Vertex;
+            if (p[1] == 't') return ObjRecord::UV;
+            if (p[1] == 'n') return ObjRecord::Normal;
+        }
+        else if (p[0] == 'f' && IsBlank(p[1]))
+        {
+            return ObjRecord::Face;
+        }
+        return ObjRecord::None;
+    }
+
+    inline const char* ParseFloat(const char* p, const char* end, float& out)
+    {
+        p = SkipBlanks(p, end);
+        if (p < end && *p == '+') ++p;
+
+        std::from_chars_result res = std::from_chars(p, end, out);
+        if (res.ec == std::errc::invalid_argument)
+        {
+            out = 0.0f;
+            return p;
+        }
+        if (res.ec == std::errc::result_out_of_range)
+            out = 0.0f;
+        return res.ptr;
+    }
+
+    inline int ResolveObjIndex(long idx, size_t count)
+    {
+        if (idx > 0) return (int)(idx - 1);
+        if (idx < 0) return (int)((long)count + idx);
+        return -1;
+    }
+
+    inline int CheckIndex(int idx, size_t total)
+    {
+        return (idx >= 0 && (size_t)idx < total) ? idx : -1;
+    }
+
+    // seen: records before this line (negative indices are relative to it), total: records in the file.
+    bool ParseFaceVertexToken(const char* token, const char* end, const ObjCounts& seen, const ObjCounts& total, ObjTriplet& out)
+    {
+        out.vi = -1; out.ti = -1; out.ni = -1;
+        long v = 0;
+        std::from_chars_result res = std::from_chars(token, end, v);
+        if (res.ec != std::errc())
+            return false;
+        out.vi = CheckIndex(ResolveObjIndex(v, seen.vertices), total.vertices);
+
+        const char* p = res.ptr;
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/')
+            {
+                long t = 0;
+                res = std::from_chars(p, end, t);
+                if (res.ec == std::errc())
+                    out.ti = CheckIndex(ResolveObjIndex(t, seen.uvs), total.uvs);
+                p = res.ptr;
+            }
+            if (p < end && *p == '/')
+            {
+                ++p;
+                long n = 0;
+                res = std::from_chars(p, end, n);
+                if (res.ec == std::errc())
+                    out.ni = CheckIndex(ResolveObjIndex(n, seen.normals), total.normals);
+            }
+        }
+        return (out.vi >= 0);
+    }
+
+    ObjCounts CountRecords(const char* begin, const char* end)
+    {
+        ObjCounts counts;
+        const char* p = begin;
+        while (p < end)
+        {
+            const char* eol = LineEnd(p, end);
+            switch (Classify(p, eol))
+            {
+            case ObjRecord::Vertex: ++counts.vertices; break;
+            case ObjRecord::UV: ++counts.uvs; break;
+            case ObjRecord::Normal: ++counts.normals; break;
+            case ObjRecord::Face:
+            {
+                size_t tokens = 0;
+                const char* q = SkipBlanks(p + 1, eol);
+                while (q < eol)
+                {
+                    ++tokens;
+                    q = SkipBlanks(SkipToken(q, eol), eol);
+                }
+                if (tokens >= 3)
+                    counts.corners += (tokens - 2) * 3;
+                break;
+            }
+            default: break;
+            }
+            p = eol + 1;
+        }
+        return counts;
+    }
+
+    // Fills the records of [begin, end) starting at the offsets in 'base'. Returns how many corners
+    // were written, which is less than counted only when a face has unusable tokens.
+    size_t ParseRecords(const char* begin, const char* end, const ObjCounts& base, const ObjCounts& total, ObjData& out)
+    {
+        ObjCounts seen = base;
+        size_t corner = base.corners;
+        const char* p = begin;
+        while (p < end)
+        {
+            const char* eol = LineEnd(p, end);
+            switch (Classify(p, eol))
+            {
+            case ObjRecord::Vertex:
+            {
+                glm::vec3& v = out.vertices[seen.vertices++];
+                const char* q = ParseFloat(p + 2, eol, v.x);
+                q = ParseFloat(q, eol, v.y);
+                ParseFloat(q, eol, v.z);
+                break;
+            }
+            case ObjRecord::UV:
+            {
+                glm::vec2& uv = out.uvs[seen.uvs++];
+                const char* q = ParseFloat(p + 2, eol, uv.x);
+                ParseFloat(q, eol, uv.y);
+                break;
+            }
+            case ObjRecord::Normal:
+            {
+                glm::vec3& n = out.normals[seen.normals++];
+                const char* q = ParseFloat(p + 2, eol, n.x);
+                q = ParseFloat(q, eol, n.y);
+                ParseFloat(q, eol, n.z);
+                break;
+            }
+            case ObjRecord::Face:
+            {
+                // Triangulate as a fan: only the first and the previous corner are needed.
+                ObjTriplet first, prev, t;
+                size_t valid = 0;
+                const char* q = SkipBlanks(p + 1, eol);
+                while (q < eol)
+                {
+                    const char* token_end = SkipToken(q, eol);
+                    if (ParseFaceVertexToken(q, token_end, seen, total, t))
+                    {
+                        if (valid >= 2)
+                        {
+                            out.corners[corner++] = first;
+                            out.corners[corner++] = prev;
+                            out.corners[corner++] = t;
+                        }
+                        if (valid == 0) first = t;
+                        prev = t;
+                        ++valid;
+                    }
+                    q = SkipBlanks(token_end, eol);
+                }
+                break;
+            }
+            default: break;
+            }
+            p = eol + 1;
+        }
+        return corner - base.corners;
+    }
+}
+
+bool LoadObj(const char* file_name, ObjData& out)
+{
+    QEM_TRACE_SCOPE("LoadObj");
+    MappedFile file;
+    if (!file.Open(file_name))
+        return false;
+
+    const char* begin = file.Data();
+    const char* end = begin + file.Size();
+
+    // Line-aligned chunks: every chunk but the first starts right after a newline.
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(Parallel::WorkerCount(), file.Size() / MIN_CHUNK_BYTES));
+    std::vector<const char*> bounds(chunk_count + 1, end);
+    bounds[0] = begin;
+    for (size_t i = 1; i < chunk_count; ++i)
+    {
+        const char* p = std::max(begin + file.Size() * i / chunk_count, bounds[i - 1]);
+        const char* eol = (p < end) ? LineEnd(p, end) : end;
+        bounds[i] = (eol < end) ? eol + 1 : end;
+    }
+
+    std::vector<ObjCounts> counts(chunk_count);
+    Parallel::For(chunk_count, 1, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t i = first; i < last; ++i)
+            counts[i] = CountRecords(bounds[i], bounds[i + 1]);
+    });
+
+    // Prefix sums turn the per-chunk counts into the offsets each chunk writes at, and give every
+    // chunk the number of records before it to resolve negative indices.
+    std::vector<ObjCounts> bases(chunk_count);
+    ObjCounts total;
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        bases[i] = total;
+        total.vertices += counts[i].vertices;
+        total.uvs += counts[i].uvs;
+        total.normals += counts[i].normals;
+        total.corners += counts[i].corners;
+    }
+
+    out.vertices.resize(total.vertices);
+    out.uvs.resize(total.uvs);
+    out.normals.resize(total.normals);
+    out.corners.resize(total.corners);
+
+    std::vector<size_t> written(chunk_count);
+    Parallel::For(chunk_count, 1, [&](size_t first, size_t last, size_t)
+    {
+        for (size_t i = first; i < last; ++i)
+            written[i] = ParseRecords(bounds[i], bounds[i + 1], bases[i], total, out);
+    });
+
+    // Faces with unusable tokens leave a gap at the end of their chunk.
+    size_t corners = written[0];
+    for (size_t i = 1; i < chunk_count; ++i)
+    {
+        if (corners != bases[i].corners)
+            std::memmove(&out.corners[corners], &out.corners[bases[i].corners], written[i] * sizeof(ObjTriplet));
+        corners += written[i];
+    }
+    out.corners.resize(corners);
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "../ThirdParty/glm/glm.hpp"
+#include <vector>
+
+struct ObjTriplet { int vi, ti, ni; };
+
+struct ObjData
+{
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<ObjTriplet> corners; // fan-triangulated faces, three corners per triangle.
+};
+
+// Parses the v/vt/vn/f records of an OBJ file straight from a memory mapping. A counting pass sizes
+// every array exactly before the parsing pass fills it, so no line is copied and no face allocates.
+// Both passes run in parallel over line-aligned chunks of the file.
+bool LoadObj(const char* file_name, ObjData& out);
@@ -0,0 +1,82 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "ObjWriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace
+{
+    constexpr size_t WRITE_BUFFER_BYTES = 1 << 20;
+    constexpr uint32_t UNUSED = 0xFFFFFFFFu;
+
+    class BufferedFile
+    {
+    public:
+        explicit BufferedFile(const char* file_name) : m_File(std::fopen(file_name, "wb")) { m_Buffer.reserve(WRITE_BUFFER_BYTES + 256); }
+        ~BufferedFile() { if (m_File) std::fclose(m_File); }
+
+        inline bool IsOpen() const { return m_File != nullptr; }
+
+        template <typename... Args>
+        void Print(const char* format, Args... args)
+        {
+            char line[256];
+            const int length = std::snprintf(line, sizeof(line), format, args...);
+            m_Buffer.append(line, (size_t)std::max(length, 0));
+            if (m_Buffer.size() >= WRITE_BUFFER_BYTES)
+                Flush();
+        }
+
+        bool Close()
+        {
+            Flush();
+            const bool ok = m_Ok && std::fclose(m_File) == 0;
+            m_File = nullptr;
+            return ok;
+        }
+
+    private:
+        void Flush()
+        {
+            m_Ok = m_Ok && std::fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File) == m_Buffer.size();
+            m_Buffer.clear();
+        }
+
+        FILE* m_File;
+        std::string m_Buffer;
+        bool m_Ok = true;
+    };
+}
+
+bool WriteObj(const char* file_name, const Mesh& mesh)
+{
+    BufferedFile file(file_name);
+    if (!file.IsOpen())
+        return false;
+
+    std::vector<uint32_t> remap(mesh.vtx.size(), UNUSED);
+    std::vector<uint32_t> order;
+    for (unsigned int v : mesh.idx)
+    {
+        if (remap[v] == UNUSED)
+        {
+            remap[v] = (uint32_t)order.size();
+            order.push_back(v);
+        }
+    }
+
+    file.Print("# %zu vertices, %zu triangles\n", order.size(), mesh.idx.size() / 3);
+    for (uint32_t v : order)
+        file.Print("v %.9g %.9g %.9g\n", mesh.vtx[v].position.x, mesh.vtx[v].position.y, mesh.vtx[v].position.z);
+    for (uint32_t v : order)
+        file.Print("vt %.9g %.9g\n", mesh.vtx[v].uv.x, mesh.vtx[v].uv.y);
+    for (uint32_t v : order)
+        file.Print("vn %.9g %.9g %.9g\n", mesh.vtx[v].normal.x, mesh.vtx[v].normal.y, mesh.vtx[v].normal.z);
+
+    for (size_t c = 0; c < mesh.idx.size(); c += 3)
+    {
+        const uint32_t a = remap[mesh.idx[c]] + 1, b = remap[mesh.idx[c + 1]] + 1, d = remap[mesh.idx[c + 2]] + 1;
+        file.Print("f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, d, d, d);
+    }
+    return file.Close();
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Model.h"
+
+// Writes the referenced vertices of 'mesh' as v/vt/vn records, renumbered in first-use order, and
+// every triangle as an f v/vt/vn record. Output goes through one large buffer.
+bool WriteObj(const char* file_name, const Mesh& mesh);
@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Parallel
+{
+	// 0 means one worker per hardware thread. May change while other threads run For: each call
+	// reads it once, and code sizing per-worker state passes its own snapshot to For.
+	inline std::atomic<unsigned> g_WorkerCount(0);
+
+	inline void SetWorkerCount(unsigned count) { g_WorkerCount.store(count, std::memory_order_relaxed); }
+
+	inline unsigned WorkerCount()
+	{
+		const unsigned count = g_WorkerCount.load(std::memory_order_relaxed);
+		if (count != 0)
+			return count;
+		unsigned hw = std::thread::hardware_concurrency();
+		return hw ? hw : 1;
+	}
+
+	namespace Detail
+	{
+		// The ranges of one For call. Ranges are claimed with 'next'; the caller waits for 'pending'.
+		struct Batch
+		{
+			void (*run)(void* body, size_t begin, size_t end, size_t worker);
+			void* body;
+			size_t count;
+			size_t workers;
+			std::atomic<size_t> next;
+			std::atomic<size_t> pending;
+
+			inline void Run(size_t w) { run(body, count * w / workers, count * (w + 1) / workers, w); }
+		};
+
+		// Threads kept alive between For calls: a batch round of SimplifyBatch makes several calls
+		// and starting threads for each one cost more than the work on small meshes. Threads are
+		// added on demand and sleep when no batch has unclaimed ranges. A caller claims its own
+		// ranges too and only waits for ranges already running, so nested and concurrent calls
+		// (one per qem-simplify job) cannot deadlock.
+		class Pool
+		{
+		public:
+			static Pool& Instance()
+			{
+				static Pool pool;
+				return pool;
+			}
+
+			~Pool()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					m_Stop = true;
+				}
+				m_Wake.notify_all();
+				for (std::thread& thread : m_Threads)
+					thread.join();
+			}
+
+			void Run(Batch& batch)
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					while (m_Threads.size() < batch.workers - 1)
+						m_Threads.emplace_back([this]() { Work(); });
+					m_Batches.push_back(&batch);
+				}
+				m_Wake.notify_all();
+
+				for (size_t w = batch.next.fetch_add(1); w < batch.workers; w = batch.next.fetch_add(1))
+					Finish(batch, w);
+
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_Batches.erase(std::remove(m_Batches.begin(), m_Batches.end(), &batch), m_Batches.end());
+				m_Done.wait(lock, [&]() { return batch.pending.load() == 0; });
+			}
+
+		private:
+			void Finish(Batch& batch, size_t w)
+			{
+				batch.Run(w);
+				if (batch.pending.fetch_sub(1) == 1)
+				{
+					// 'batch' may be gone once pending is 0, only the pool is touched from here.
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					m_Done.notify_all();
+				}
+			}
+
+			void Work()
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				while (true)
+				{
+					m_Wake.wait(lock, [&]() { return m_Stop || !m_Batches.empty(); });
+					if (m_Stop)
+						return;
+
+					// Claimed under the lock: a listed batch is alive until its caller unlists it.
+					Batch* batch = m_Batches.front();
+					const size_t w = batch->next.fetch_add(1);
+					if (w + 1 >= batch->workers)
+						m_Batches.erase(m_Batches.begin());
+					if (w >= batch->workers)
+						continue;
+
+					lock.unlock();
+					Finish(*batch, w);
+					lock.lock();
+				}
+			}
+
+			std::mutex m_Mutex;
+			std::condition_variable m_Wake;
+			std::condition_variable m_Done;
+			std::vector<Batch*> m_Batches;
+			std::vector<std::thread> m_Threads;
+			bool m_Stop = false;
+		};
+	}
+
+	// Splits [0, count) into at most 'workers' contiguous ranges of at least 'grain' items and calls
+	// body(begin, end, worker) for each one, 'worker' being the index of the range, below 'workers'.
+	// The ranges run on the calling thread and the threads of a persistent pool.
+	template <typename Body>
+	void For(size_t count, size_t grain, size_t workers, Body&& body)
+	{
+		if (count == 0)
+			return;
+
+		workers = std::min<size_t>(workers, (count + grain - 1) / std::max<size_t>(grain, 1));
+		workers = std::max<size_t>(workers, 1);
+		if (workers == 1)
+		{
+			body((size_t)0, count, (size_t)0);
+			return;
+		}
+
+		using BodyType = std::remove_reference_t<Body>;
+		Detail::Batch batch;
+		batch.run = [](void* b, size_t begin, size_t end, size_t worker) { (*static_cast<BodyType*>(b))(begin, end, worker); };
+		batch.body = const_cast<void*>(static_cast<const void*>(&body));
+		batch.count = count;
+		batch.workers = workers;
+		batch.next.store(0);
+		batch.pending.store(workers);
+		Detail::Pool::Instance().Run(batch);
+	}
+
+	// Same with the current WorkerCount().
+	template <typename Body>
+	void For(size_t count, size_t grain, Body&& body)
+	{
+		For(count, grain, WorkerCount(), std::forward<Body>(body));
+	}
+
+	// Job queue for items of uneven cost: 'workers' threads keep taking the next index until all
+	// 'count' are done and call body(index, worker). The calling thread is worker 0.
+	template <typename Body>
+	void Queue(size_t count, size_t workers, Body&& body)
+	{
+		workers = std::max<size_t>(1, std::min(workers, count));
+		std::atomic<size_t> next(0);
+		auto Work = [&](size_t worker)
+		{
+			for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+				body(i, worker);
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(workers - 1);
+		for (size_t w = 1; w < workers; ++w)
+			threads.emplace_back(Work, w);
+
+		Work(0);
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+}
@@ -0,0 +1,74 @@
+#include "ProgressiveMesh.h"
+#include <algorithm>
+
+ProgressiveMesh::ProgressiveMesh(const std::vector<Vertex>& vertices, const CollapseLog& log)
+    : m_Vertices(vertices)
+{
+    constexpr uint32_t UNPLACED = 0xFFFFFFFFu;
+
+    // Base faces keep their order, collapsed faces follow from the last collapse to the first.
+    std::vector<uint32_t> position(log.origin.size() / 3, UNPLACED);
+    for (const CollapseLog::Entry& entry : log.entries)
+        position[entry.dead[0]] = position[entry.dead[1]] = 0;
+
+    uint32_t next = 0;
+    for (uint32_t face : log.faces)
+        if (position[face] == UNPLACED) position[face] = next++;
+    m_BaseFaces = next;
+
+    for (size_t i = log.entries.size(); i-- > 0;)
+    {
+        position[log.entries[i].dead[0]] = next++;
+        position[log.entries[i].dead[1]] = next++;
+    }
+
+    m_Indices.resize((size_t)next * 3);
+    for (uint32_t face : log.faces)
+        for (uint32_t k = 0; k < 3; ++k)
+            m_Indices[position[face] * 3 + k] = log.origin[face * 3 + k];
+
+    m_Records.reserve(log.entries.size());
+    m_Corners.reserve(log.moved.size());
+    uint32_t moved = 0;
+    for (const CollapseLog::Entry& entry : log.entries)
+    {
+        for (; moved < entry.moved_end; ++moved)
+        {
+            const uint32_t h = log.moved[moved];
+            m_Corners.push_back(position[h / 3] * 3 + h % 3);
+        }
+        m_Records.push_back({ entry.v1, entry.v2, (uint32_t)m_Corners.size() });
+    }
+
+    SetLevel(m_Records.size());
+}
+
+void ProgressiveMesh::SetLevel(size_t level)
+{
+    level = std::min(level, m_Records.size());
+
+    // Edge collapses forward, vertex splits back.
+    for (; m_Level < level; ++m_Level)
+    {
+        const Record& record = m_Records[m_Level];
+        for (uint32_t c = m_Level ? m_Records[m_Level - 1].corner_end : 0; c < record.corner_end; ++c)
+            m_Indices[m_Corners[c]] = record.v2;
+    }
+
+    for (; m_Level > level; --m_Level)
+    {
+        const Record& record = m_Records[m_Level - 1];
+        for (uint32_t c = m_Level > 1 ? m_Records[m_Level - 2].corner_end : 0; c < record.corner_end; ++c)
+            m_Indices[m_Corners[c]] = record.v1;
+    }
+}
+
+void ProgressiveMesh::SetFaceCount(size_t faces)
+{
+    if (faces >= MaxFaceCount())
+        SetLevel(0);
+    else if (faces <= m_BaseFaces)
+        SetLevel(m_Records.size());
+    else
+        SetLevel(m_Records.size() - (faces - m_BaseFaces) / 2);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "Model.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Collapses in the order the simplifier applied them, in topology numbering. Model fills it between
+// BeginRecording and EndRecording; faces are not compacted meanwhile so the numbering holds.
+struct CollapseLog
+{
+	struct Entry
+	{
+		uint32_t v1, v2;     // v1 merged into v2.
+		uint32_t dead[2];    // the two faces of the edge.
+		uint32_t moved_end;  // end of this entry's halfedges in 'moved'.
+	};
+
+	std::vector<uint32_t> origin; // corners of every face when recording started.
+	std::vector<uint32_t> faces;  // faces alive when recording started.
+	std::vector<Entry> entries;
+	std::vector<uint32_t> moved;  // halfedges that left v1 and now leave v2.
+
+	// Call after pushing the entry's halfedges to 'moved'.
+	void Add(uint32_t v1, uint32_t v2, uint32_t dead0, uint32_t dead1)
+	{
+		entries.push_back({ v1, v2, { dead0, dead1 }, (uint32_t)moved.size() });
+	}
+
+	void Append(const CollapseLog& other)
+	{
+		const uint32_t base = (uint32_t)moved.size();
+		for (Entry entry : other.entries)
+		{
+			entry.moved_end += base;
+			entries.push_back(entry);
+		}
+		moved.insert(moved.end(), other.moved.begin(), other.moved.end());
+	}
+};
+
+// Hoppe-style progressive mesh over a shared vertex buffer. Faces are ordered so the mesh after any
+// number of collapses is a prefix of the index buffer: the base mesh first, then the two faces of
+// every collapse from the last to the first. Each record lists the corners it moved from v1 to v2,
+// so a collapse or its vertex split costs O(valence) and any two levels are |a - b| records apart.
+class ProgressiveMesh
+{
+public:
+	struct Record
+	{
+		uint32_t v1, v2;
+		uint32_t corner_end; // corners [previous corner_end, corner_end) of 'm_Corners'.
+	};
+
+public:
+	ProgressiveMesh() = default;
+	ProgressiveMesh(const std::vector<Vertex>& vertices, const CollapseLog& log); // starts fully collapsed.
+
+public:
+	void SetLevel(size_t level); // collapses applied, 0 is the mesh when recording started.
+	void SetFaceCount(size_t faces); // finest level with at most 'faces' faces, the base mesh if none has.
+
+	inline size_t Level() const { return m_Level; }
+	inline size_t LevelCount() const { return m_Records.size() + 1; }
+	inline size_t FaceCount() const { return m_BaseFaces + 2 * (m_Records.size() - m_Level); }
+	inline size_t MaxFaceCount() const { return m_BaseFaces + 2 * m_Records.size(); }
+
+	// The current mesh is the first FaceCount() * 3 indices.
+	inline const std::vector<unsigned int>& GetIndices() const { return m_Indices; }
+	inline const std::vector<Vertex>& GetVertices() const { return m_Vertices; }
+
+private:
+	std::vector<Vertex> m_Vertices;
+	std::vector<unsigned int> m_Indices;
+	std::vector<Record> m_Records;
+	std::vector<uint32_t> m_Corners;
+	size_t m_BaseFaces = 0;
+	size_t m_Level = 0;
+};
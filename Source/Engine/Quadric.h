@@ -0,0 +1,54 @@
+#pragma once
+#include "../ThirdParty/glm/glm.hpp"
+
+// Symmetric 4x4 error quadric K_p = p p^T of a plane p = (a, b, c, d), kept as its 10 distinct
+// coefficients in double so sums over large scans far from the origin keep their precision.
+struct Quadric
+{
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+
+	static inline Quadric Zero() { return { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }; }
+
+	static inline Quadric FromPlane(double a, double b, double c, double d)
+	{
+		return { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+	}
+
+	// Plane through the triangle (p1, p2, p3), computed in double. Degenerate triangles have no
+	// plane and contribute nothing instead of NaNs.
+	static inline Quadric FromTriangle(const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3)
+	{
+		glm::dvec3 v1(p1);
+		glm::dvec3 np = glm::cross(glm::dvec3(p2) - v1, glm::dvec3(p3) - v1);
+		double length = glm::length(np);
+		if (!(length > 0.0))
+			return Zero();
+
+		glm::dvec3 n = np / length;
+		return FromPlane(n.x, n.y, n.z, -glm::dot(n, v1));
+	}
+
+	inline Quadric& operator+=(const Quadric& o)
+	{
+		a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+		b2 += o.b2; bc += o.bc; bd += o.bd;
+		c2 += o.c2; cd += o.cd;
+		d2 += o.d2;
+		return *this;
+	}
+
+	friend inline Quadric operator+(Quadric q, const Quadric& o) { return q += o; }
+
+	// v^T Q v with v = (p, 1).
+	inline double Evaluate(const glm::vec3& p) const
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		return x * (a2 * x + 2.0 * (ab * y + ac * z + ad))
+			+ y * (b2 * y + 2.0 * (bc * z + bd))
+			+ z * (c2 * z + 2.0 * cd)
+			+ d2;
+	}
+};
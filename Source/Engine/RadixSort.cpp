@@ -0,0 +1,66 @@
+#include "RadixSort.h"
+#include "Parallel.h"
+#include <array>
+
+namespace
+{
+    constexpr size_t RADIX_GRAIN = 1 << 16;
+}
+
+void RadixSort(std::vector<SortPair>& pairs)
+{
+    const size_t count = pairs.size();
+    if (count < 2)
+        return;
+
+    uint64_t all_or = 0, all_and = ~0ull;
+    for (const SortPair& p : pairs)
+    {
+        all_or |= p.key;
+        all_and &= p.key;
+    }
+    const uint64_t varying = all_or ^ all_and;
+
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(Parallel::WorkerCount(), (count + RADIX_GRAIN - 1) / RADIX_GRAIN));
+    std::vector<std::array<size_t, 256>> offsets(workers);
+    std::vector<SortPair> scratch(count);
+
+    for (uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        if (((varying >> shift) & 0xFF) == 0)
+            continue;
+
+        for (auto& histogram : offsets)
+            histogram.fill(0);
+
+        auto range_begin = [&](size_t w) { return count * w / workers; };
+
+        Parallel::For(workers, 1, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t w = first; w < last; ++w)
+                for (size_t i = range_begin(w); i < range_begin(w + 1); ++i)
+                    ++offsets[w][(pairs[i].key >> shift) & 0xFF];
+        });
+
+        // Exclusive scan in digit-major, worker-minor order keeps the sort stable.
+        size_t sum = 0;
+        for (size_t digit = 0; digit < 256; ++digit)
+        {
+            for (size_t w = 0; w < workers; ++w)
+            {
+                size_t n = offsets[w][digit];
+                offsets[w][digit] = sum;
+                sum += n;
+            }
+        }
+
+        Parallel::For(workers, 1, [&](size_t first, size_t last, size_t)
+        {
+            for (size_t w = first; w < last; ++w)
+                for (size_t i = range_begin(w); i < range_begin(w + 1); ++i)
+                    scratch[offsets[w][(pairs[i].key >> shift) & 0xFF]++] = pairs[i];
+        });
+
+        pairs.swap(scratch);
+    }
+}
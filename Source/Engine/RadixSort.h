@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct SortPair
+{
+	uint64_t key;
+	uint32_t value;
+};
+
+// Stable LSD radix sort on 'key', 8 bits per pass. Digits that are equal across all keys are
+// skipped and every pass histograms and scatters in parallel over contiguous worker ranges.
+void RadixSort(std::vector<SortPair>& pairs);
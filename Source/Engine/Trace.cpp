@@ -0,0 +1,196 @@
+#include "Trace.h"
+
+#if QEM_TRACE
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct Event
+    {
+        const char* name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // Parallel::Queue spawns its threads per call, so buffers outlive them: a thread takes a free
+    // buffer on its first event and hands it back on exit. Trace ids stay few and stable.
+    struct ThreadBuffer
+    {
+        uint32_t tid;
+        bool in_use;
+        std::vector<Event> events;
+    };
+
+    struct CounterSample
+    {
+        uint64_t time;
+        std::vector<int64_t> values; // one per counter registered at the time of the sample.
+    };
+
+    struct TraceState
+    {
+        std::mutex mutex;
+        std::deque<Trace::Counter> counters; // deque: registered references stay valid.
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::vector<CounterSample> samples;
+        const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    };
+
+    TraceState& State()
+    {
+        static TraceState state;
+        return state;
+    }
+
+    struct ThreadSlot
+    {
+        ThreadBuffer* buffer = nullptr;
+
+        ~ThreadSlot()
+        {
+            if (!buffer) return;
+            std::lock_guard<std::mutex> lock(State().mutex);
+            buffer->in_use = false;
+        }
+    };
+
+    thread_local ThreadSlot t_Slot;
+
+    ThreadBuffer& LocalBuffer()
+    {
+        if (t_Slot.buffer)
+            return *t_Slot.buffer;
+
+        TraceState& state = State();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (const auto& buffer : state.buffers)
+        {
+            if (!buffer->in_use)
+            {
+                buffer->in_use = true;
+                return *(t_Slot.buffer = buffer.get());
+            }
+        }
+        state.buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer{ (uint32_t)state.buffers.size(), true, {} }));
+        return *(t_Slot.buffer = state.buffers.back().get());
+    }
+
+    inline double Micro(uint64_t ns) { return (double)ns / 1000.0; }
+}
+
+namespace Trace
+{
+    Counter& RegisterCounter(const char* name)
+    {
+        TraceState& state = State();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (Counter& counter : state.counters)
+        {
+            if (std::strcmp(counter.name, name) == 0)
+                return counter;
+        }
+        state.counters.emplace_back();
+        Counter& counter = state.counters.back();
+        counter.name = name;
+        counter.value.store(0, std::memory_order_relaxed);
+        return counter;
+    }
+
+    void Add(Counter& counter, int64_t value)
+    {
+        counter.value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Set(Counter& counter, int64_t value)
+    {
+        counter.value.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - State().origin).count();
+    }
+
+    void RecordEvent(const char* name, uint64_t begin, uint64_t end)
+    {
+        LocalBuffer().events.push_back({ name, begin, end });
+    }
+
+    void Sample()
+    {
+        CounterSample sample;
+        sample.time = Now();
+        TraceState& state = State();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        sample.values.reserve(state.counters.size());
+        for (const Counter& counter : state.counters)
+            sample.values.push_back(counter.value.load(std::memory_order_relaxed));
+        state.samples.push_back(std::move(sample));
+    }
+
+    // Call with no traced work in flight: event buffers are appended to without the lock.
+    bool WriteChromeTrace(const char* file_name)
+    {
+        FILE* file = fopen(file_name, "w");
+        if (!file)
+        {
+            printf("[Error] Fail trying to write the trace: %s\n", file_name);
+            return false;
+        }
+
+        TraceState& state = State();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        const char* separator = "\n";
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (const auto& buffer : state.buffers)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                separator, buffer->tid, buffer->tid ? "worker" : "main", buffer->tid);
+            separator = ",\n";
+            for (const Event& event : buffer->events)
+            {
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, buffer->tid, Micro(event.begin), Micro(event.end - event.begin));
+            }
+        }
+        for (const CounterSample& sample : state.samples)
+        {
+            for (size_t c = 0; c < sample.values.size(); ++c)
+            {
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                    separator, state.counters[c].name, Micro(sample.time), (long long)sample.values[c]);
+                separator = ",\n";
+            }
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+    void PrintCounters()
+    {
+        TraceState& state = State();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (const Counter& counter : state.counters)
+            printf("  %-32s %lld\n", counter.name, (long long)counter.value.load(std::memory_order_relaxed));
+    }
+
+    void Reset()
+    {
+        TraceState& state = State();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (Counter& counter : state.counters)
+            counter.value.store(0, std::memory_order_relaxed);
+        for (const auto& buffer : state.buffers)
+            buffer->events.clear();
+        state.samples.clear();
+    }
+}
+
+#endif
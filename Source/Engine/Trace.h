@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Scoped timers and counters, exported as Chrome trace JSON (chrome://tracing, Perfetto). Build
+// with QEM_TRACE=1 to record; otherwise every macro expands to nothing and no code is emitted.
+//
+//   QEM_TRACE_SCOPE("name")          one complete event per execution, for phases and rounds.
+//   QEM_TRACE_SCOPE_TOTAL("name")    adds the time to counter "name.ns" and one to "name.calls",
+//                                    for functions called per edge or per collapse.
+//   QEM_TRACE_COUNT("name", n)       adds n to a counter.
+//   QEM_TRACE_GAUGE("name", v)       sets a counter.
+//   QEM_TRACE_SAMPLE()               records the current value of every counter in the trace.
+#ifndef QEM_TRACE
+#define QEM_TRACE 0
+#endif
+
+#if QEM_TRACE
+
+namespace Trace
+{
+	struct Counter
+	{
+		const char* name;
+		std::atomic<int64_t> value; // bumped from worker threads.
+	};
+
+	Counter& RegisterCounter(const char* name); // one counter per name, shared by every call site.
+	void Add(Counter& counter, int64_t value);
+	void Set(Counter& counter, int64_t value);
+
+	uint64_t Now(); // nanoseconds since the first trace call.
+	void RecordEvent(const char* name, uint64_t begin, uint64_t end);
+	void Sample();
+
+	bool WriteChromeTrace(const char* file_name);
+	void PrintCounters();
+	void Reset();
+
+	class Scope
+	{
+	public:
+		explicit Scope(const char* name) : m_Name(name), m_Begin(Now()) {}
+		~Scope() { RecordEvent(m_Name, m_Begin, Now()); }
+
+	private:
+		const char* m_Name;
+		uint64_t m_Begin;
+	};
+
+	class TotalScope
+	{
+	public:
+		TotalScope(Counter& time, Counter& calls) : m_Time(time), m_Begin(Now()) { Add(calls, 1); }
+		~TotalScope() { Add(m_Time, (int64_t)(Now() - m_Begin)); }
+
+	private:
+		Counter& m_Time;
+		uint64_t m_Begin;
+	};
+}
+
+#define QEM_TRACE_CONCAT_(a, b) a##b
+#define QEM_TRACE_CONCAT(a, b) QEM_TRACE_CONCAT_(a, b)
+#define QEM_TRACE_SCOPE(name) Trace::Scope QEM_TRACE_CONCAT(qem_trace_scope_, __LINE__)(name)
+#define QEM_TRACE_SCOPE_TOTAL(name) \
+	static Trace::Counter& QEM_TRACE_CONCAT(qem_trace_time_, __LINE__) = Trace::RegisterCounter(name ".ns"); \
+	static Trace::Counter& QEM_TRACE_CONCAT(qem_trace_calls_, __LINE__) = Trace::RegisterCounter(name ".calls"); \
+	Trace::TotalScope QEM_TRACE_CONCAT(qem_trace_total_, __LINE__)(QEM_TRACE_CONCAT(qem_trace_time_, __LINE__), QEM_TRACE_CONCAT(qem_trace_calls_, __LINE__))
+#define QEM_TRACE_COUNT(name, n) do { static Trace::Counter& qem_trace_counter = Trace::RegisterCounter(name); Trace::Add(qem_trace_counter, (int64_t)(n)); } while (0)
+#define QEM_TRACE_GAUGE(name, v) do { static Trace::Counter& qem_trace_counter = Trace::RegisterCounter(name); Trace::Set(qem_trace_counter, (int64_t)(v)); } while (0)
+#define QEM_TRACE_SAMPLE() Trace::Sample()
+
+#else
+
+#define QEM_TRACE_SCOPE(name) ((void)0)
+#define QEM_TRACE_SCOPE_TOTAL(name) ((void)0)
+#define QEM_TRACE_COUNT(name, n) ((void)0)
+#define QEM_TRACE_GAUGE(name, v) ((void)0)
+#define QEM_TRACE_SAMPLE() ((void)0)
+
+#endif
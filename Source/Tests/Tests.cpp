@@ -0,0 +1,986 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "../Engine/EdgeHeap.h"
+#include "../Engine/MeshOptimizer.h"
+#include "../Engine/Model.h"
+#include "../Engine/ObjParser.h"
+#include "../Engine/Parallel.h"
+#include "../Engine/ProgressiveMesh.h"
+#include "../Engine/Trace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Engine invariants the tools do not check on their own, one function per behaviour, all listed
+// in main. Usage: qem-tests <source dir with the bundled meshes> <scratch dir>; ctest runs it.
+namespace fs = std::filesystem;
+
+// Drives the private steps of a loaded model, like ModelBench, and reports what the checks compare.
+class ModelTest
+{
+public:
+    // Collapses the first 'collapses' safe edges the heap hands out under Accumulate. Returns how
+    // many collapses left the quadrics different from the old ones with Q2 replaced by Q2 + Q1.
+    static size_t AccumulateMismatches(Model& model, unsigned int collapses)
+    {
+        model.SetQuadricUpdate(QuadricUpdate::Accumulate);
+        size_t mismatches = 0;
+        unsigned int done = 0;
+        while (done < collapses && !model.m_Heap.Empty())
+        {
+            const uint32_t h = model.m_Heap.Pop();
+            if (!model.IsCollapseSafe(h))
+                continue;
+
+            const uint32_t v1 = model.m_Topology.origin[h], v2 = model.m_Topology.Dest(h);
+            std::vector<Quadric> expected = model.m_Quadrics;
+            expected[v2] += expected[v1];
+            model.EdgeCollapse(h);
+            model.PrepareQEMData();
+            mismatches += std::memcmp(expected.data(), model.m_Quadrics.data(), expected.size() * sizeof(Quadric)) != 0;
+            ++done;
+        }
+        return mismatches;
+    }
+
+    // The link condition with a plain vector for the one-ring of v1, matched entries erased.
+    static bool ReferenceLinkCondition(const HalfEdgeMesh& topology, uint32_t halfedge)
+    {
+        std::vector<uint32_t> ring;
+        uint32_t h = halfedge;
+        do {
+            if (topology.twin[h] == HalfEdgeMesh::INVALID)
+                return false;
+            ring.push_back(topology.Dest(h));
+            h = HalfEdgeMesh::Next(topology.twin[h]);
+        } while (h != halfedge);
+
+        const uint32_t next = HalfEdgeMesh::Next(halfedge);
+        size_t shared = 0;
+        h = next;
+        do {
+            if (topology.twin[h] == HalfEdgeMesh::INVALID)
+                return false;
+            auto it = std::find(ring.begin(), ring.end(), topology.Dest(h));
+            if (it != ring.end())
+            {
+                ring.erase(it);
+                ++shared;
+            }
+            h = HalfEdgeMesh::Next(topology.twin[h]);
+        } while (h != next);
+        return shared == 2;
+    }
+
+    // Greedy collapses of the first 'collapses' safe edges. After each one, 'stale' counts cached edge
+    // states that disagree with LinkCondition and 'wrong' the halfedges where LinkCondition
+    // disagrees with the reference.
+    static void CheckLinkStates(Model& model, unsigned int collapses, size_t& stale, size_t& wrong)
+    {
+        stale = wrong = 0;
+        unsigned int done = 0;
+        while (done < collapses && !model.m_Heap.Empty())
+        {
+            const uint32_t edge = model.m_Heap.Pop();
+            if (!model.IsCollapseSafe(edge))
+                continue;
+            model.EdgeCollapse(edge);
+            model.PrepareQEMData();
+            ++done;
+
+            for (uint32_t face : model.m_Topology.live)
+            {
+                for (uint32_t h = face * 3; h < face * 3 + 3; ++h)
+                {
+                    const bool safe = model.LinkCondition(h);
+                    stale += model.m_EdgeState[h] != EdgeState::Unknown && (model.m_EdgeState[h] == EdgeState::Safe) != safe;
+                    wrong += safe != ReferenceLinkCondition(model.m_Topology, h);
+                }
+            }
+        }
+    }
+
+    // LinkCondition of v1 -> v2 on a hand-built topology: the fan of v1 over u_0 .. u_{valence-1},
+    // with v2 = u_0 and u_1 twice in the fan of v2 (u_1, a, u_1, u_{valence-1}, v1). Only the two fans
+    // are stitched, nothing else is read. u_1 is shared once, u_{valence-1} once: the edge is safe.
+    static bool RepeatedNeighbourLink(Model& model, uint32_t valence)
+    {
+        const uint32_t v1 = 0, a = valence + 1;
+        auto U = [valence](uint32_t i) { return 1 + i % valence; };
+        std::vector<uint32_t>& origin = model.m_Topology.origin;
+        std::vector<uint32_t>& twin = model.m_Topology.twin;
+        origin.clear();
+        for (uint32_t i = 0; i < valence; ++i)
+            origin.insert(origin.end(), { v1, U(i), U(i + 1) });
+        const uint32_t extra = valence;
+        origin.insert(origin.end(), { U(0), a, U(1), U(0), U(1), a, U(0), U(valence - 1), U(1) });
+        twin.assign(origin.size(), HalfEdgeMesh::INVALID);
+
+        // Consecutive faces of a fan around 'center': the halfedge leaving it in one face is the twin
+        // of the halfedge entering it in the next.
+        auto StitchFan = [&](uint32_t center, const std::vector<uint32_t>& fan)
+        {
+            auto Leaving = [&](uint32_t face)
+            {
+                uint32_t h = face * 3;
+                while (origin[h] != center) ++h;
+                return h;
+            };
+            for (size_t k = 0; k < fan.size(); ++k)
+            {
+                const uint32_t out = Leaving(fan[k]);
+                const uint32_t in = HalfEdgeMesh::Prev(Leaving(fan[(k + 1) % fan.size()]));
+                twin[out] = in;
+                twin[in] = out;
+            }
+        };
+        std::vector<uint32_t> fan_v1;
+        for (uint32_t i = valence; i-- > 0;)
+            fan_v1.push_back(i);
+        StitchFan(v1, fan_v1);
+        StitchFan(U(0), { 0, extra, extra + 1, extra + 2, valence - 1 });
+        return model.LinkCondition(0);
+    }
+
+    // Sum of the quadrics of the vertices the live faces use.
+    static Quadric ReferencedQuadricSum(const Model& model)
+    {
+        std::vector<bool> used(model.m_Quadrics.size(), false);
+        Quadric sum = Quadric::Zero();
+        for (unsigned int v : model.m_Mesh.idx)
+        {
+            if (!used[v])
+                sum += model.m_Quadrics[v];
+            used[v] = true;
+        }
+        return sum;
+    }
+};
+
+namespace
+{
+    size_t g_Failures = 0;
+    std::string g_Mesh;    // bundled mesh with open boundaries, simplified by several checks.
+    std::string g_Scratch; // generated OBJs and caches.
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+    bool Check(bool ok, const char* expression, const char* file, int line)
+    {
+        if (!ok)
+        {
+            printf("[Error] %s:%d: %s\n", file, line, expression);
+            ++g_Failures;
+        }
+        return ok;
+    }
+
+    const SimplifyStrategy STRATEGIES[] = { SimplifyStrategy::Greedy, SimplifyStrategy::Batch, SimplifyStrategy::MultipleChoice };
+
+    LoadOptions TestLoadOptions()
+    {
+        LoadOptions options;
+        options.use_cache = false;
+        options.verbose = false;
+        return options;
+    }
+
+    bool WriteText(const std::string& file_name, const std::string& text)
+    {
+        FILE* file = fopen(file_name.c_str(), "wb");
+        if (!file)
+            return false;
+        const bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        return (fclose(file) == 0) && ok;
+    }
+
+    // Non-degenerate triangles rotated to start at their smallest vertex, sorted: two index buffers
+    // describe the same mesh when their canonical forms are equal.
+    typedef std::vector<std::array<unsigned int, 3>> Faces;
+
+    Faces Canonical(const unsigned int* idx, size_t faces)
+    {
+        Faces result;
+        for (size_t f = 0; f < faces; ++f)
+        {
+            std::array<unsigned int, 3> t = { idx[f * 3], idx[f * 3 + 1], idx[f * 3 + 2] };
+            if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2])
+                continue;
+            std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+            result.push_back(t);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    // A size x size grid of quads in z = 0, every corner written as v/vt/vn with equal indices.
+    std::string GridObj(unsigned int size)
+    {
+        std::string text;
+        char line[128];
+        for (unsigned int y = 0; y <= size; ++y)
+        {
+            for (unsigned int x = 0; x <= size; ++x)
+            {
+                std::snprintf(line, sizeof(line), "v %u %u 0\nvt %g %g\nvn 0 0 1\n", x, y, (double)x / size, (double)y / size);
+                text += line;
+            }
+        }
+        for (unsigned int y = 0; y < size; ++y)
+        {
+            for (unsigned int x = 0; x < size; ++x)
+            {
+                const unsigned int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+                std::snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, d, d, d, c, c, c);
+                text += line;
+            }
+        }
+        return text;
+    }
+
+    void TestEdgeHeap()
+    {
+        constexpr uint32_t COUNT = 4096;
+        EdgeHeap heap;
+        heap.Reset(COUNT);
+        std::vector<float> cost(COUNT);
+        std::vector<bool> queued(COUNT, true);
+        uint32_t state = 12345;
+        auto Random = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+
+        for (uint32_t id = 0; id < COUNT; ++id)
+            heap.Append(id, cost[id] = (float)(Random() % 1000));
+        heap.Build();
+        for (uint32_t i = 0; i < COUNT; ++i)
+        {
+            const uint32_t id = Random() % COUNT;
+            if (Random() % 4 == 0)
+            {
+                heap.Remove(id);
+                queued[id] = false;
+            }
+            else
+            {
+                heap.Update(id, cost[id] = (float)(Random() % 1000));
+                queued[id] = true;
+            }
+        }
+
+        const size_t expected = (size_t)std::count(queued.begin(), queued.end(), true);
+        CHECK(heap.Size() == expected);
+        float last = -1.0f;
+        size_t popped = 0;
+        bool ordered = true, exact = true;
+        while (!heap.Empty())
+        {
+            const float top = heap.TopCost();
+            const uint32_t id = heap.Pop();
+            ordered = ordered && top >= last;
+            exact = exact && queued[id] && cost[id] == top;
+            queued[id] = false;
+            last = top;
+            ++popped;
+        }
+        CHECK(ordered);
+        CHECK(exact);
+        CHECK(popped == expected);
+    }
+
+    void TestRelativeIndices()
+    {
+        // Each triangle lists its own vertices just before it, so negative indices cross chunk
+        // boundaries once the file is split between workers.
+        constexpr unsigned int TRIANGLES = 100000;
+        std::string absolute, relative;
+        char line[128];
+        for (unsigned int t = 0; t < TRIANGLES; ++t)
+        {
+            std::snprintf(line, sizeof(line), "v %u 0 0\nv %u 1 0\nv %u 0 1\n", t, t, t);
+            absolute += line;
+            relative += line;
+            std::snprintf(line, sizeof(line), "f %u %u %u\n", t * 3 + 1, t * 3 + 2, t * 3 + 3);
+            absolute += line;
+            relative += "f -3 -2 -1\n";
+        }
+        const std::string absolute_name = g_Scratch + "/indices_absolute.obj";
+        const std::string relative_name = g_Scratch + "/indices_relative.obj";
+        if (!CHECK(WriteText(absolute_name, absolute)) || !CHECK(WriteText(relative_name, relative)))
+            return;
+
+        const unsigned int workers = Parallel::WorkerCount();
+        Parallel::SetWorkerCount(4);
+        ObjData a, b;
+        CHECK(LoadObj(absolute_name.c_str(), a));
+        CHECK(LoadObj(relative_name.c_str(), b));
+        Parallel::SetWorkerCount(workers);
+
+        CHECK(a.corners.size() == TRIANGLES * 3);
+        CHECK(a.corners.size() == b.corners.size());
+        bool same = true;
+        for (size_t c = 0; c < std::min(a.corners.size(), b.corners.size()); ++c)
+            same = same && a.corners[c].vi == b.corners[c].vi && b.corners[c].vi == (int)c;
+        CHECK(same);
+    }
+
+    // The hash-grid weld WeldPositions replaced: corners in file order, each reusing the first vertex
+    // within eps found in the 27 neighbour cells, probed in z, y, x order and insertion order.
+    void GridWeld(const ObjData& obj, float eps, std::vector<Vertex>& vtx, std::vector<unsigned int>& idx)
+    {
+        struct CellKey
+        {
+            int64_t x, y, z;
+            bool operator==(const CellKey& o) const { return x == o.x && y == o.y && z == o.z; }
+        };
+        struct CellHasher
+        {
+            size_t operator()(const CellKey& k) const { return ((size_t)k.x * 73856093) ^ ((size_t)k.y * 19349663) ^ ((size_t)k.z * 83492791); }
+        };
+        std::unordered_map<CellKey, std::vector<unsigned int>, CellHasher> grid;
+
+        for (const ObjTriplet& t : obj.corners)
+        {
+            Vertex cand;
+            cand.position = obj.vertices[t.vi];
+            cand.uv = t.ti >= 0 ? obj.uvs[t.ti] : glm::vec2(0.0f);
+            cand.normal = t.ni >= 0 ? obj.normals[t.ni] : glm::vec3(0.0f, 0.0f, 1.0f);
+            const CellKey key = { (int64_t)(cand.position.x / eps), (int64_t)(cand.position.y / eps), (int64_t)(cand.position.z / eps) };
+
+            int found = -1;
+            for (int64_t dz = -1; dz <= 1 && found < 0; ++dz)
+            {
+                for (int64_t dy = -1; dy <= 1 && found < 0; ++dy)
+                {
+                    for (int64_t dx = -1; dx <= 1 && found < 0; ++dx)
+                    {
+                        auto it = grid.find({ key.x + dx, key.y + dy, key.z + dz });
+                        if (it == grid.end())
+                            continue;
+                        for (unsigned int existing : it->second)
+                        {
+                            const glm::vec3 d = glm::abs(vtx[existing].position - cand.position);
+                            if (d.x <= eps && d.y <= eps && d.z <= eps)
+                            {
+                                found = (int)existing;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (found < 0)
+            {
+                found = (int)vtx.size();
+                vtx.push_back(cand);
+                grid[key].push_back((unsigned int)found);
+            }
+            idx.push_back((unsigned int)found);
+        }
+    }
+
+    void TestGeometricWeld()
+    {
+        // Every quad of a 40 x 40 grid writes its own four 'v' records, jittered by up to 0.6 eps on
+        // each axis. Copies of a grid point may or may not weld and chains depend on the order, so
+        // this only matches the grid weld if the creation and probe orders are reproduced exactly.
+        constexpr unsigned int SIZE = 40;
+        constexpr float EPS = 1e-4f;
+        const float offsets[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+        uint32_t state = 777;
+        auto Jitter = [&state]() { state = state * 1664525u + 1013904223u; return ((float)(state >> 8) / 16777216.0f - 0.5f) * 1.2f * EPS; };
+
+        std::string text;
+        char line[160];
+        for (unsigned int q = 0; q < SIZE * SIZE; ++q)
+        {
+            for (const auto& o : offsets)
+            {
+                const float x = ((float)(q % SIZE) + o[0]) * 10.0f * EPS, y = ((float)(q / SIZE) + o[1]) * 10.0f * EPS;
+                std::snprintf(line, sizeof(line), "v %.9g %.9g %.9g\nvt %g %g\n", x + Jitter(), y + Jitter(), Jitter(), o[0], o[1]);
+                text += line;
+            }
+            const unsigned int v = q * 4 + 1;
+            std::snprintf(line, sizeof(line), "f %u/%u %u/%u %u/%u\nf %u/%u %u/%u %u/%u\n", v, v, v + 1, v + 1, v + 2, v + 2, v, v, v + 2, v + 2, v + 3, v + 3);
+            text += line;
+        }
+        const std::string file_name = g_Scratch + "/weld_jitter.obj";
+        if (!CHECK(WriteText(file_name, text)))
+            return;
+
+        ObjData obj;
+        CHECK(LoadObj(file_name.c_str(), obj));
+        std::vector<Vertex> expected_vtx;
+        std::vector<unsigned int> expected_idx;
+        GridWeld(obj, EPS, expected_vtx, expected_idx);
+        CHECK(expected_vtx.size() > (SIZE + 1) * (SIZE + 1) && expected_vtx.size() < obj.vertices.size());
+
+        for (const std::string& mesh : { file_name, g_Mesh })
+        {
+            ObjData source;
+            LoadObj(mesh.c_str(), source);
+            std::vector<Vertex> vtx;
+            std::vector<unsigned int> idx;
+            GridWeld(source, EPS, vtx, idx);
+
+            LoadOptions options = TestLoadOptions();
+            options.weld = WeldMode::Geometric;
+            options.weld_eps = EPS;
+            Model model(mesh.c_str(), options);
+            CHECK(model.GetMesh().idx == idx);
+            bool same = model.GetMesh().vtx.size() == vtx.size();
+            for (size_t v = 0; same && v < vtx.size(); ++v)
+                same = model.GetMesh().vtx[v].position == vtx[v].position && model.GetMesh().vtx[v].uv == vtx[v].uv;
+            CHECK(same);
+        }
+    }
+
+    void TestWeldModes()
+    {
+        // Every 'v' has one vt and one vn, so all three modes must agree.
+        const std::string file_name = g_Scratch + "/weld_grid.obj";
+        if (!CHECK(WriteText(file_name, GridObj(16))))
+            return;
+
+        LoadOptions options = TestLoadOptions();
+        options.weld = WeldMode::IndexTriplet;
+        Model triplet(file_name.c_str(), options);
+        options.weld = WeldMode::PositionIndex;
+        Model position(file_name.c_str(), options);
+        options.weld = WeldMode::Geometric;
+        Model geometric(file_name.c_str(), options);
+
+        CHECK(triplet.GetMesh().vtx.size() == 17 * 17);
+        CHECK(triplet.GetMesh().idx.size() == 16 * 16 * 6);
+        CHECK(triplet.GetMesh().idx == position.GetMesh().idx);
+        CHECK(triplet.GetMesh().vtx.size() == position.GetMesh().vtx.size());
+        CHECK(triplet.GetMesh().idx == geometric.GetMesh().idx);
+        CHECK(triplet.GetMesh().vtx.size() == geometric.GetMesh().vtx.size());
+    }
+
+    void TestMeshCache()
+    {
+        const std::string file_name = g_Scratch + "/cache_grid.obj";
+        const std::string cache_name = file_name + ".qemcache";
+        std::remove(cache_name.c_str());
+        if (!CHECK(WriteText(file_name, GridObj(12))))
+            return;
+
+        // Off by default: the library never writes next to the caller's files unless asked.
+        CHECK(!LoadOptions().use_cache);
+        {
+            Model model(file_name.c_str(), TestLoadOptions());
+            CHECK(!fs::exists(cache_name));
+        }
+
+        LoadOptions options = TestLoadOptions();
+        options.use_cache = true;
+        std::vector<unsigned int> reference;
+        {
+            Model model(file_name.c_str(), options);
+            CHECK(!model.GetLoadTimings().from_cache);
+            reference = model.GetMesh().idx;
+        }
+        {
+            Model model(file_name.c_str(), options);
+            CHECK(model.GetLoadTimings().from_cache);
+            CHECK(model.GetMesh().idx == reference);
+        }
+
+        // Each damage must make the next load a miss that parses the OBJ and rewrites the cache. The
+        // version follows the 8-byte magic; the index and twin sections are the last two of the file,
+        // with no padding between them since 12 * 12 * 6 indices are a multiple of 16 bytes.
+        const long section = (long)(reference.size() * sizeof(uint32_t));
+        const struct { long offset; int origin; uint32_t value; } damages[] = {
+            { 8, SEEK_SET, 0xFFFFu },                 // version
+            { -2 * section, SEEK_END, 0x7FFFFFFFu },  // first index
+            { -4, SEEK_END, 0x7FFFFFF0u },            // last twin, out of range
+            { -4, SEEK_END, 0u },                     // last twin, not pointing back
+            { 0, SEEK_END, 0u },                      // truncated instead of patched
+        };
+        for (const auto& damage : damages)
+        {
+            if (damage.offset == 0)
+            {
+                fs::resize_file(cache_name, fs::file_size(cache_name) - 16);
+            }
+            else if (FILE* file = fopen(cache_name.c_str(), "r+b"))
+            {
+                fseek(file, damage.offset, damage.origin);
+                CHECK(fwrite(&damage.value, sizeof(damage.value), 1, file) == 1);
+                fclose(file);
+            }
+            {
+                Model model(file_name.c_str(), options);
+                CHECK(!model.GetLoadTimings().from_cache);
+                CHECK(model.GetMesh().idx == reference);
+            }
+            Model model(file_name.c_str(), options);
+            CHECK(model.GetLoadTimings().from_cache);
+        }
+
+        // Same size, new bytes: the write time tells them apart. Set explicitly, the filesystem clock
+        // may be too coarse to see two writes this close.
+        const fs::file_time_type written = fs::last_write_time(file_name);
+        std::string source = GridObj(12);
+        source.replace(source.find("vn 0 0 1"), 8, "vn 0 1 0");
+        CHECK(WriteText(file_name, source));
+        fs::last_write_time(file_name, written + std::chrono::seconds(1));
+        {
+            Model model(file_name.c_str(), options);
+            CHECK(!model.GetLoadTimings().from_cache);
+        }
+        std::remove(cache_name.c_str());
+    }
+
+    void TestAccumulatedQuadrics()
+    {
+        {
+            Model model(g_Mesh.c_str(), TestLoadOptions());
+            CHECK(ModelTest::AccumulateMismatches(model, 500) == 0);
+        }
+
+        // Q2 + Q1 moves the quadric of v1 onto v2, so the quadrics of the vertices still in use sum
+        // to the initial total whatever the strategy.
+        for (SimplifyStrategy strategy : STRATEGIES)
+        {
+            Model model(g_Mesh.c_str(), TestLoadOptions());
+            model.SetQuadricUpdate(QuadricUpdate::Accumulate);
+            const Quadric before = ModelTest::ReferencedQuadricSum(model);
+            SimplifyOptions options;
+            options.ratio = 0.2f;
+            options.strategy = strategy;
+            CHECK(model.Simplify(options).collapses > 0);
+            const Quadric after = ModelTest::ReferencedQuadricSum(model);
+
+            const double* b = &before.a2;
+            const double* a = &after.a2;
+            bool conserved = true;
+            for (int i = 0; i < 10; ++i)
+                conserved = conserved && std::abs(a[i] - b[i]) <= 1e-9 * std::max(1.0, std::abs(b[i]));
+            CHECK(conserved);
+        }
+    }
+
+    // A closed bipyramid: two apices of the given valence over an equator.
+    std::string BipyramidObj(unsigned int valence)
+    {
+        std::string text = "v 0 0 1\nv 0 0 -1\n";
+        char line[128];
+        for (unsigned int i = 0; i < valence; ++i)
+        {
+            const double angle = 6.283185307179586 * i / valence;
+            std::snprintf(line, sizeof(line), "v %.9f %.9f %.9f\n", std::cos(angle), std::sin(angle), 0.05 * (i % 3));
+            text += line;
+        }
+        for (unsigned int i = 0; i < valence; ++i)
+        {
+            const unsigned int e0 = 3 + i, e1 = 3 + (i + 1) % valence;
+            std::snprintf(line, sizeof(line), "f 1 %u %u\nf 2 %u %u\n", e0, e1, e1, e0);
+            text += line;
+        }
+        return text;
+    }
+
+    void TestLinkCondition()
+    {
+        // Inline buffer and in-place search must agree when a neighbour repeats around v2.
+        {
+            Model model(g_Mesh.c_str(), TestLoadOptions());
+            CHECK(ModelTest::RepeatedNeighbourLink(model, 20));
+            CHECK(ModelTest::RepeatedNeighbourLink(model, 40));
+        }
+
+        const std::string file_name = g_Scratch + "/bipyramid.obj";
+        if (!CHECK(WriteText(file_name, BipyramidObj(48))))
+            return;
+        for (const std::string& mesh : { g_Mesh, file_name })
+        {
+            Model model(mesh.c_str(), TestLoadOptions());
+            size_t stale = 0, wrong = 0;
+            ModelTest::CheckLinkStates(model, 40, stale, wrong);
+            CHECK(stale == 0);
+            CHECK(wrong == 0);
+        }
+    }
+
+    void TestBatchWorkers()
+    {
+        // One seed, one mesh, whatever the worker count: the claims are decided by priority, not by
+        // which thread gets there first. The last run changes the count while the batch runs.
+        const unsigned int saved = Parallel::WorkerCount();
+        auto Run = [](unsigned int workers, std::atomic<bool>* flip)
+        {
+            Parallel::SetWorkerCount(workers);
+            Model model(g_Mesh.c_str(), TestLoadOptions());
+            std::thread flipper;
+            if (flip)
+            {
+                flipper = std::thread([flip]()
+                {
+                    for (unsigned int i = 0; flip->load(); ++i)
+                    {
+                        Parallel::SetWorkerCount(1 + i % 8);
+                        std::this_thread::yield();
+                    }
+                });
+            }
+            SimplifyOptions options;
+            options.ratio = 0.2f;
+            options.strategy = SimplifyStrategy::Batch;
+            options.seed = 42;
+            model.Simplify(options);
+            if (flip)
+            {
+                flip->store(false);
+                flipper.join();
+            }
+            return model.GetMesh().idx;
+        };
+
+        const std::vector<unsigned int> reference = Run(1, nullptr);
+        CHECK(!reference.empty());
+        for (unsigned int workers : { 2u, 3u, 8u })
+            CHECK(Run(workers, nullptr) == reference);
+        std::atomic<bool> flip(true);
+        CHECK(Run(4, &flip) == reference);
+        Parallel::SetWorkerCount(saved);
+    }
+
+    void TestMultipleChoice()
+    {
+        auto Run = [](uint32_t seed, unsigned int choices, float max_error, SimplifyResult& result)
+        {
+            Model model(g_Mesh.c_str(), TestLoadOptions());
+            SimplifyOptions options;
+            options.ratio = 0.25f;
+            options.strategy = SimplifyStrategy::MultipleChoice;
+            options.seed = seed;
+            options.choices = choices;
+            options.max_error = max_error;
+            result = model.Simplify(options);
+
+            const Mesh& mesh = model.GetMesh();
+            bool valid = true;
+            for (size_t i = 0; i < mesh.idx.size(); i += 3)
+            {
+                const unsigned int* t = &mesh.idx[i];
+                valid = valid && t[0] < mesh.vtx.size() && t[1] < mesh.vtx.size() && t[2] < mesh.vtx.size();
+                valid = valid && t[0] != t[1] && t[1] != t[2] && t[0] != t[2];
+            }
+            CHECK(valid);
+            CHECK(result.final_triangles == mesh.idx.size() / 3);
+            return mesh.idx;
+        };
+
+        for (unsigned int choices : { 1u, 8u })
+        {
+            SimplifyResult first, again, other;
+            const std::vector<unsigned int> a = Run(7, choices, FLT_MAX, first);
+            CHECK(first.stop == SimplifyStop::Budget);
+            CHECK(first.final_triangles <= (size_t)(first.initial_triangles * 0.25f) + 1);
+            CHECK(Run(7, choices, FLT_MAX, again) == a); // a seed is a mesh.
+            CHECK(Run(8, choices, FLT_MAX, other) != a);
+
+            // No applied collapse may cost more than the limit, even if that misses the target.
+            SimplifyResult bounded;
+            const float limit = first.max_error * 0.01f;
+            Run(7, choices, limit, bounded);
+            CHECK(bounded.max_error <= limit);
+            CHECK(bounded.collapses > 0);
+        }
+    }
+
+    void TestStopReasons()
+    {
+        // A strip of quads: every vertex is on the boundary, so no edge passes the link condition.
+        std::string strip;
+        char line[128];
+        for (unsigned int i = 0; i <= 8; ++i)
+        {
+            std::snprintf(line, sizeof(line), "v %u 0 0\nv %u 1 0\n", i, i);
+            strip += line;
+        }
+        for (unsigned int i = 0; i < 8; ++i)
+        {
+            const unsigned int a = i * 2 + 1;
+            std::snprintf(line, sizeof(line), "f %u %u %u\nf %u %u %u\n", a, a + 2, a + 3, a, a + 3, a + 1);
+            strip += line;
+        }
+        const std::string strip_name = g_Scratch + "/strip.obj";
+        if (!CHECK(WriteText(strip_name, strip)))
+            return;
+
+        for (SimplifyStrategy strategy : STRATEGIES)
+        {
+            auto Run = [strategy](SimplifyOptions options, const std::string& mesh = g_Mesh)
+            {
+                Model model(mesh.c_str(), TestLoadOptions());
+                options.strategy = strategy;
+                return model.Simplify(options);
+            };
+
+            SimplifyOptions options;
+            options.target_triangles = 3000;
+            SimplifyResult result = Run(options);
+            CHECK(result.stop == SimplifyStop::Budget);
+            CHECK(result.final_triangles <= 3000 && result.final_triangles >= 2999);
+
+            options = SimplifyOptions();
+            options.ratio = 0.5f;
+            result = Run(options);
+            CHECK(result.stop == SimplifyStop::Budget);
+            CHECK(result.final_triangles <= (result.initial_triangles + 1) / 2);
+
+            // Both set: the larger count is reached first.
+            options.target_triangles = (unsigned int)(result.initial_triangles * 3 / 4);
+            result = Run(options);
+            CHECK(result.stop == SimplifyStop::Budget);
+            CHECK(result.final_triangles <= options.target_triangles && result.final_triangles + 2 > options.target_triangles);
+
+            options = SimplifyOptions();
+            options.max_collapses = 10;
+            result = Run(options);
+            CHECK(result.stop == SimplifyStop::Budget);
+            CHECK(result.collapses == 10);
+
+            options = SimplifyOptions();
+            options.ratio = 0.1f;
+            const float unbounded = Run(options).max_error;
+            options.max_error = unbounded * 0.001f;
+            result = Run(options);
+            CHECK(result.stop == SimplifyStop::MaxError);
+            CHECK(result.max_error <= options.max_error);
+            CHECK(result.final_triangles > (size_t)(result.initial_triangles * 0.1f) + 1);
+
+            // Cancelled up front, and from the progress callback once a third is done.
+            std::atomic<bool> cancel(true);
+            options = SimplifyOptions();
+            options.ratio = 0.1f;
+            options.cancel = &cancel;
+            result = Run(options);
+            CHECK(result.stop == SimplifyStop::Cancelled);
+            CHECK(result.collapses == 0);
+
+            cancel.store(false);
+            options.progress = [&cancel](float done) { if (done >= 0.3f) cancel.store(true); };
+            result = Run(options);
+            CHECK(result.stop == SimplifyStop::Cancelled);
+            CHECK(result.collapses > 0 && result.final_triangles > (size_t)(result.initial_triangles * 0.1f) + 1);
+
+            options = SimplifyOptions();
+            options.ratio = 0.5f;
+            result = Run(options, strip_name);
+            CHECK(result.stop == SimplifyStop::NoValidEdges);
+            CHECK(result.collapses == 0);
+        }
+    }
+
+    void TestProgressiveMesh()
+    {
+        for (SimplifyStrategy strategy : STRATEGIES)
+        {
+            Model model(g_Mesh.c_str(), TestLoadOptions());
+            const Faces original = Canonical(model.GetMesh().idx.data(), model.GetMesh().idx.size() / 3);
+            model.BeginRecording();
+            SimplifyOptions options;
+            options.ratio = 0.1f;
+            options.strategy = strategy;
+            model.Simplify(options);
+            const Faces simplified = Canonical(model.GetMesh().idx.data(), model.GetMesh().idx.size() / 3);
+            ProgressiveMesh pm = model.EndRecording();
+
+            CHECK(pm.FaceCount() == model.GetMesh().idx.size() / 3);
+            CHECK(Canonical(pm.GetIndices().data(), pm.FaceCount()) == simplified);
+            pm.SetLevel(0);
+            CHECK(Canonical(pm.GetIndices().data(), pm.FaceCount()) == original);
+            pm.SetFaceCount(pm.MaxFaceCount() / 2);
+            CHECK(pm.FaceCount() <= pm.MaxFaceCount() / 2);
+            pm.SetLevel(pm.LevelCount() - 1);
+            CHECK(Canonical(pm.GetIndices().data(), pm.FaceCount()) == simplified);
+        }
+    }
+
+    void TestLodChain()
+    {
+        Model model(g_Mesh.c_str(), TestLoadOptions());
+        const size_t initial = model.GetMesh().idx.size() / 3;
+        std::vector<LodRequest> requests(4);
+        requests[0].ratio = 0.25f;
+        requests[1].ratio = 1.0f;
+        requests[2].ratio = 0.05f;
+        requests[3].ratio = 0.25f; // duplicate, shares the level of requests[0].
+        const LodChain chain = model.SimplifyLods(requests);
+
+        CHECK(chain.levels.size() == 3);
+        CHECK(!chain.levels.empty() && chain.levels[0].indices.size() / 3 == initial);
+        const size_t order[] = { 1, 0, 2 };
+        for (size_t i = 0; i < chain.levels.size() && i < 3; ++i)
+            CHECK(chain.levels[i].request == order[i]);
+        for (size_t i = 0; i < chain.levels.size(); ++i)
+        {
+            const LodChain::Level& level = chain.levels[i];
+            const unsigned int highest = level.indices.empty() ? 0 : *std::max_element(level.indices.begin(), level.indices.end());
+            CHECK(highest < level.vertex_count);
+            CHECK(level.vertex_count <= chain.vertices.size());
+            if (i > 0)
+            {
+                CHECK(level.indices.size() < chain.levels[i - 1].indices.size());
+                CHECK(level.vertex_count <= chain.levels[i - 1].vertex_count);
+                CHECK(level.max_error >= chain.levels[i - 1].max_error);
+            }
+        }
+    }
+
+    // An error bound hit long before a ratio comes first, whatever the order of the requests.
+    void TestMixedLodChain()
+    {
+        std::vector<LodRequest> requests(2);
+        requests[0].ratio = 0.2f;
+        requests[1].max_error = 1e-9f;
+        for (SimplifyStrategy strategy : STRATEGIES)
+        {
+            Model model((fs::path(g_Mesh).parent_path() / "stanford-bunny.obj").string().c_str(), TestLoadOptions());
+            const size_t initial = model.GetMesh().idx.size() / 3;
+            SimplifyOptions options;
+            options.strategy = strategy;
+            const LodChain chain = model.SimplifyLods(requests, options);
+
+            CHECK(chain.levels.size() == 2);
+            if (chain.levels.size() != 2)
+                continue;
+            CHECK(chain.levels[0].request == 1);
+            CHECK(chain.levels[0].max_error <= requests[1].max_error);
+            CHECK(chain.levels[1].request == 0);
+            CHECK(chain.levels[1].indices.size() / 3 <= (size_t)std::ceil(requests[0].ratio * initial));
+            CHECK(chain.levels[1].indices.size() < chain.levels[0].indices.size());
+        }
+    }
+
+    void TestDirtyRanges()
+    {
+        Model model(g_Mesh.c_str(), TestLoadOptions());
+        std::vector<unsigned int> shadow = model.GetMesh().idx;
+        std::vector<IndexRange> ranges;
+        size_t mismatches = 0;
+        for (SimplifyStrategy strategy : STRATEGIES)
+        {
+            for (int step = 0; step < 20 && model.GetMesh().idx.size() > 600; ++step)
+            {
+                SimplifyOptions options;
+                options.strategy = strategy;
+                options.max_collapses = strategy == SimplifyStrategy::Greedy ? 37 : 200;
+                model.Simplify(options);
+                model.TakeDirtyRanges(ranges);
+
+                const std::vector<unsigned int>& idx = model.GetMesh().idx;
+                shadow.resize(idx.size());
+                for (const IndexRange& range : ranges)
+                {
+                    CHECK(range.first + range.count <= idx.size());
+                    std::copy(idx.begin() + range.first, idx.begin() + range.first + range.count, shadow.begin() + range.first);
+                }
+                mismatches += shadow != idx;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    // Tipsify keeps the triangles and lowers ACMR, with or without the overdraw sort; renumbering
+    // the vertices after it leaves the order, and so the ACMR, alone.
+    void TestVertexCacheOrder()
+    {
+        Model model(g_Mesh.c_str(), TestLoadOptions());
+        const Mesh& source = model.GetMesh();
+        const Faces original = Canonical(source.idx.data(), source.idx.size() / 3);
+        for (float threshold : { 0.0f, OptimizeOptions().overdraw_threshold })
+        {
+            OptimizeOptions options;
+            options.overdraw_threshold = threshold;
+            options.compact_vertices = false;
+            Mesh ordered = source;
+            const OptimizeReport report = OptimizeMesh(ordered, options);
+            CHECK(Canonical(ordered.idx.data(), ordered.idx.size() / 3) == original);
+            CHECK(report.before.acmr == AnalyzeVertexCache(source.idx, source.vtx.size()).acmr);
+            CHECK(report.after.acmr == AnalyzeVertexCache(ordered.idx, ordered.vtx.size()).acmr);
+            CHECK(report.after.acmr < report.before.acmr);
+            CHECK(report.after.atvr >= 1.0f);
+
+            options.compact_vertices = true;
+            Mesh compact = source;
+            const OptimizeReport compacted = OptimizeMesh(compact, options);
+            CHECK(compacted.after.acmr == report.after.acmr);
+            CHECK(compacted.vertices_after == compact.vtx.size() && compact.vtx.size() <= source.vtx.size());
+            CHECK(compact.idx.size() == source.idx.size());
+            CHECK(std::all_of(compact.idx.begin(), compact.idx.end(), [&](unsigned int v) { return v < compact.vtx.size(); }));
+        }
+    }
+
+#if QEM_TRACE
+    void TestTraceCounters()
+    {
+        // Two call sites of the same name, e.g. the rejected_candidates of each strategy.
+        Trace::Counter& first = Trace::RegisterCounter("tests.shared");
+        Trace::Counter& second = Trace::RegisterCounter("tests.shared");
+        CHECK(&first == &second);
+        Trace::Add(first, 2);
+        Trace::Add(second, 3);
+        CHECK(first.value.load() == 5);
+        CHECK(&Trace::RegisterCounter("tests.other") != &first);
+    }
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: qem-tests <source dir> <scratch dir>\n");
+        return 2;
+    }
+    g_Mesh = std::string(argv[1]) + "/monster.obj";
+    g_Scratch = argv[2];
+
+    struct Test
+    {
+        const char* name;
+        void (*run)();
+    };
+    const Test tests[] = {
+        { "edge heap", TestEdgeHeap },
+        { "relative indices", TestRelativeIndices },
+        { "geometric weld", TestGeometricWeld },
+        { "weld modes", TestWeldModes },
+        { "mesh cache", TestMeshCache },
+        { "accumulated quadrics", TestAccumulatedQuadrics },
+        { "link condition", TestLinkCondition },
+        { "batch workers", TestBatchWorkers },
+        { "multiple choice", TestMultipleChoice },
+        { "stop reasons", TestStopReasons },
+        { "progressive mesh", TestProgressiveMesh },
+        { "lod chain", TestLodChain },
+        { "mixed lod chain", TestMixedLodChain },
+        { "dirty ranges", TestDirtyRanges },
+        { "vertex cache order", TestVertexCacheOrder },
+#if QEM_TRACE
+        { "trace counters", TestTraceCounters },
+#endif
+    };
+
+    for (const Test& test : tests)
+    {
+        const size_t before = g_Failures;
+        test.run();
+        printf("%-20s %s\n", test.name, g_Failures == before ? "ok" : "FAILED");
+    }
+    return g_Failures ? 1 : 0;
+}
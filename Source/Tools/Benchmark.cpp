@@ -0,0 +1,405 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "../Engine/Model.h"
+#include "../Engine/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+// Runs the private steps of a loaded model in isolation. Every measure leaves the model in a state
+// only fit for the next measure of the same kind, so each one gets a fresh load.
+class ModelBench
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Cost of every live halfedge.
+    static double EdgeCost(const Model& model)
+    {
+        const auto start = Clock::now();
+        float sink = 0.0f;
+        size_t count = 0;
+        for (uint32_t face : model.m_Topology.live)
+            for (uint32_t h = face * 3; h < face * 3 + 3; ++h, ++count)
+                sink += model.EdgeCost(h);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        Consume(sink);
+        return count ? seconds / (double)count : 0.0;
+    }
+
+    // IsCollapseSafe on every live halfedge with an empty cache, so each call walks the link.
+    static double IsCollapseSafe(Model& model)
+    {
+        std::fill(model.m_EdgeState.begin(), model.m_EdgeState.end(), EdgeState::Unknown);
+        const auto start = Clock::now();
+        size_t safe = 0, count = 0;
+        for (uint32_t face : model.m_Topology.live)
+        {
+            for (uint32_t h = face * 3; h < face * 3 + 3; ++h, ++count)
+            {
+                model.m_EdgeState[h] = EdgeState::Unknown; // the twin was cached by the previous call.
+                safe += model.IsCollapseSafe(h);
+            }
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        Consume((float)safe);
+        return count ? seconds / (double)count : 0.0;
+    }
+
+    // EdgeCollapse alone and the quadric/heap update that follows it, over the first 'collapses'
+    // safe edges the heap hands out.
+    static void EdgeCollapse(Model& model, unsigned int collapses, double& collapse, double& update)
+    {
+        collapse = update = 0.0;
+        unsigned int done = 0;
+        while (done < collapses && !model.m_Heap.Empty())
+        {
+            const uint32_t h = model.m_Heap.Pop();
+            if (!model.IsCollapseSafe(h))
+                continue;
+
+            const auto start = Clock::now();
+            model.EdgeCollapse(h);
+            const auto middle = Clock::now();
+            model.PrepareQEMData();
+            const auto end = Clock::now();
+            collapse += std::chrono::duration<double>(middle - start).count();
+            update += std::chrono::duration<double>(end - middle).count();
+            ++done;
+        }
+        if (done)
+        {
+            collapse /= (double)done;
+            update /= (double)done;
+        }
+    }
+
+private:
+    // Keeps the measured loop alive: the value is an input the optimizer cannot see through.
+    static void Consume(float value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile float sink;
+        sink = value;
+        (void)sink;
+#endif
+    }
+};
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const char* const MESHES[] = { "sphere.obj", "toro.obj", "barril.obj", "monster.obj", "stanford-bunny.obj" };
+    const SimplifyStrategy STRATEGIES[] = { SimplifyStrategy::Greedy, SimplifyStrategy::Batch, SimplifyStrategy::MultipleChoice };
+    const char* const STRATEGY_NAMES[] = { "greedy", "batch", "mc" };
+    constexpr unsigned int MICRO_COLLAPSES = 1000;
+
+    double Median(std::vector<double> samples)
+    {
+        if (samples.empty())
+            return 0.0;
+        std::sort(samples.begin(), samples.end());
+        const size_t mid = samples.size() / 2;
+        return samples.size() % 2 ? samples[mid] : 0.5 * (samples[mid - 1] + samples[mid]);
+    }
+
+    struct BenchConfig
+    {
+        unsigned int reps = 5;
+        std::vector<float> ratios = { 0.5f, 0.25f, 0.1f, 0.01f };
+        bool micro = true;
+    };
+
+    // The kernel keeps the high-water mark of the resident set; writing 5 to clear_refs resets it
+    // (Linux 4.0+), so each measure gets its own peak. Elsewhere, or on older kernels, the peaks
+    // are those of the process so far.
+    void ResetPeakMemory()
+    {
+#ifdef __linux__
+        if (FILE* file = std::fopen("/proc/self/clear_refs", "w"))
+        {
+            std::fputs("5", file);
+            std::fclose(file);
+        }
+#endif
+    }
+
+    double PeakMemoryMiB()
+    {
+#ifdef __linux__
+        if (FILE* file = std::fopen("/proc/self/status", "r"))
+        {
+            char line[256];
+            double kib = -1.0;
+            while (kib < 0.0 && std::fgets(line, sizeof(line), file))
+                if (!std::strncmp(line, "VmHWM:", 6)) kib = std::atof(line + 6);
+            std::fclose(file);
+            if (kib >= 0.0)
+                return kib / 1024.0;
+        }
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (double)usage.ru_maxrss / 1024.0;
+#else
+        return 0.0;
+#endif
+    }
+
+    // Metrics are flat "mesh/group/name" keys; lower is better for all of them. Triangle counts
+    // are kept apart so a plot can put them on the x axis.
+    struct Results
+    {
+        std::vector<std::pair<std::string, double>> metrics;
+        std::vector<std::pair<std::string, size_t>> triangles;
+
+        void Add(const std::string& key, const std::vector<double>& samples)
+        {
+            metrics.push_back({ key, Median(samples) });
+        }
+    };
+
+    LoadOptions BenchLoadOptions()
+    {
+        LoadOptions options;
+        options.use_cache = false;
+        options.verbose = false;
+        return options;
+    }
+
+    bool BenchMesh(const std::string& path, const std::string& name, const BenchConfig& config, Results& results)
+    {
+        const unsigned int reps = config.reps;
+        const std::string prefix = name + "/";
+        std::vector<double> read, weld, topology, quadrics, total, load_peak;
+        MemoryReport memory;
+        for (unsigned int r = 0; r < reps; ++r)
+        {
+            ResetPeakMemory();
+            Model model(path.c_str(), BenchLoadOptions());
+            load_peak.push_back(PeakMemoryMiB());
+            if (model.GetMesh().idx.empty())
+                return false;
+            if (r == 0)
+            {
+                results.triangles.push_back({ name, model.GetMesh().idx.size() / 3 });
+                memory = model.GetMemoryReport();
+            }
+            const LoadTimings& t = model.GetLoadTimings();
+            read.push_back(t.read);
+            weld.push_back(t.weld);
+            topology.push_back(t.topology);
+            quadrics.push_back(t.quadrics);
+            total.push_back(t.total);
+        }
+        results.Add(prefix + "load/parse", read);
+        results.Add(prefix + "load/weld", weld);
+        results.Add(prefix + "load/generate_mesh_data", topology);
+        results.Add(prefix + "load/prepare_qem_data", quadrics);
+        results.Add(prefix + "load/total", total);
+        results.Add(prefix + "load/peak_mib", load_peak);
+
+        // Sizes do not vary between repetitions, one load is enough.
+        const double MIB = 1024.0 * 1024.0;
+        for (const MemoryEntry& entry : memory.structures)
+            results.Add(prefix + "memory/" + entry.name + "_mib", { (double)entry.bytes / MIB });
+        for (const MemoryEntry& entry : memory.transients)
+            results.Add(prefix + "memory/" + entry.name + "_mib", { (double)entry.bytes / MIB });
+        for (const MemoryPhase& phase : memory.phases)
+            results.Add(prefix + "memory/" + phase.name + "_peak_mib", { (double)phase.peak / MIB });
+
+        for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); ++s)
+        {
+            for (float ratio : config.ratios)
+            {
+                std::vector<double> seconds, peak;
+                for (unsigned int r = 0; r < reps; ++r)
+                {
+                    Model model(path.c_str(), BenchLoadOptions());
+                    SimplifyOptions options;
+                    options.ratio = ratio;
+                    options.strategy = STRATEGIES[s];
+                    ResetPeakMemory();
+                    seconds.push_back(model.Simplify(options).seconds);
+                    peak.push_back(PeakMemoryMiB());
+                }
+                char key[128];
+                std::snprintf(key, sizeof(key), "simplify/%s/%g", STRATEGY_NAMES[s], ratio);
+                results.Add(prefix + key, seconds);
+                results.Add(prefix + key + "/peak_mib", peak);
+            }
+        }
+
+        if (!config.micro)
+            return true;
+
+        std::vector<double> cost, safe, collapse, update;
+        for (unsigned int r = 0; r < reps; ++r)
+        {
+            Model model(path.c_str(), BenchLoadOptions());
+            cost.push_back(ModelBench::EdgeCost(model) * 1e9);
+            safe.push_back(ModelBench::IsCollapseSafe(model) * 1e9);
+            double c = 0.0, u = 0.0;
+            ModelBench::EdgeCollapse(model, MICRO_COLLAPSES, c, u);
+            collapse.push_back(c * 1e9);
+            update.push_back(u * 1e9);
+        }
+        results.Add(prefix + "micro/edge_cost_ns", cost);
+        results.Add(prefix + "micro/is_collapse_safe_ns", safe);
+        results.Add(prefix + "micro/edge_collapse_ns", collapse);
+        results.Add(prefix + "micro/collapse_update_ns", update);
+        return true;
+    }
+
+    bool WriteJson(const char* file_name, const Results& results, unsigned int reps)
+    {
+        FILE* file = std::fopen(file_name, "w");
+        if (!file)
+            return false;
+        std::fprintf(file, "{\n  \"reps\": %u,\n  \"workers\": %u,\n  \"unit\": \"medians in seconds, *_ns in nanoseconds, *_mib in MiB\",\n  \"triangles\": {\n",
+            reps, Parallel::WorkerCount());
+        for (size_t i = 0; i < results.triangles.size(); ++i)
+            std::fprintf(file, "    \"%s\": %zu%s\n", results.triangles[i].first.c_str(), results.triangles[i].second, i + 1 < results.triangles.size() ? "," : "");
+        std::fprintf(file, "  },\n  \"metrics\": {\n");
+        for (size_t i = 0; i < results.metrics.size(); ++i)
+            std::fprintf(file, "    \"%s\": %.9g%s\n", results.metrics[i].first.c_str(), results.metrics[i].second, i + 1 < results.metrics.size() ? "," : "");
+        std::fprintf(file, "  }\n}\n");
+        return std::fclose(file) == 0;
+    }
+
+    // Reads back the "metrics" of a file written by WriteJson, one "key": value per line.
+    bool ReadJson(const char* file_name, std::map<std::string, double>& metrics)
+    {
+        FILE* file = std::fopen(file_name, "r");
+        if (!file)
+            return false;
+        char line[512];
+        while (std::fgets(line, sizeof(line), file))
+        {
+            const char* open = std::strchr(line, '"');
+            const char* close = open ? std::strchr(open + 1, '"') : nullptr;
+            if (!close || close[1] != ':')
+                continue;
+            const std::string key(open + 1, close);
+            if (key.find('/') != std::string::npos)
+                metrics[key] = std::atof(close + 2);
+        }
+        std::fclose(file);
+        return true;
+    }
+
+    // A metric regresses when it is slower than the baseline by more than 'tolerance'. Tiny values
+    // are too noisy to gate on.
+    size_t Compare(const Results& results, const std::map<std::string, double>& baseline, double tolerance)
+    {
+        constexpr double NOISE_FLOOR = 1e-3;
+        size_t regressions = 0;
+        for (const std::pair<std::string, double>& metric : results.metrics)
+        {
+            const auto it = baseline.find(metric.first);
+            if (it == baseline.end() || it->second <= 0.0)
+                continue;
+            const bool nanoseconds = metric.first.size() > 3 && metric.first.compare(metric.first.size() - 3, 3, "_ns") == 0;
+            if (!nanoseconds && it->second < NOISE_FLOOR && metric.second < NOISE_FLOOR)
+                continue;
+
+            const double change = metric.second / it->second - 1.0;
+            if (change > tolerance)
+            {
+                printf("[Regression] %s: %.6g -> %.6g (%+.1f%%)\n", metric.first.c_str(), it->second, metric.second, change * 100.0);
+                ++regressions;
+            }
+        }
+        return regressions;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir = ".";
+    std::vector<std::string> meshes;
+    const char* output = "bench.json";
+    const char* baseline = nullptr;
+    double tolerance = 0.10;
+    BenchConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--dir") && has_value) dir = argv[++i];
+        else if (!std::strcmp(argv[i], "--mesh") && has_value) meshes.push_back(argv[++i]);
+        else if (!std::strcmp(argv[i], "--out") && has_value) output = argv[++i];
+        else if (!std::strcmp(argv[i], "--baseline") && has_value) baseline = argv[++i];
+        else if (!std::strcmp(argv[i], "--tolerance") && has_value) tolerance = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--reps") && has_value) config.reps = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--workers") && has_value) Parallel::SetWorkerCount((unsigned int)std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--no-micro")) config.micro = false;
+        else if (!std::strcmp(argv[i], "--ratios") && has_value)
+        {
+            config.ratios.clear();
+            for (char* p = argv[++i]; *p;)
+            {
+                char* end = nullptr;
+                config.ratios.push_back(std::strtof(p, &end));
+                p = *end == ',' ? end + 1 : end + std::strlen(end);
+            }
+        }
+        else
+        {
+            printf("Usage: qem-bench [--dir <meshes> | --mesh <file.obj>...] [--out bench.json] [--reps 5]\n"
+                   "                 [--ratios 0.5,0.25,0.1,0.01] [--no-micro] [--workers n]\n"
+                   "                 [--baseline old.json] [--tolerance 0.10]\n");
+            return 2;
+        }
+    }
+
+    // Without --mesh, the meshes bundled with the repository.
+    std::vector<std::pair<std::string, std::string>> inputs;
+    for (const std::string& mesh : meshes)
+        inputs.push_back({ mesh, mesh.substr(mesh.find_last_of("/\\") + 1) });
+    if (inputs.empty())
+        for (const char* mesh : MESHES)
+            inputs.push_back({ dir + "/" + mesh, mesh });
+
+    Results results;
+    for (const std::pair<std::string, std::string>& input : inputs)
+    {
+        const auto start = Clock::now();
+        if (!BenchMesh(input.first, input.second, config, results))
+        {
+            printf("[Error] Fail trying to load the benchmark mesh: %s\n", input.first.c_str());
+            return 1;
+        }
+        printf("%-20s %.2fs\n", input.second.c_str(), std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    if (!WriteJson(output, results, config.reps))
+    {
+        printf("[Error] Fail trying to write the results: %s\n", output);
+        return 1;
+    }
+    printf("Wrote %zu metrics to %s\n", results.metrics.size(), output);
+
+    if (baseline)
+    {
+        std::map<std::string, double> previous;
+        if (!ReadJson(baseline, previous))
+        {
+            printf("[Error] Fail trying to read the baseline: %s\n", baseline);
+            return 1;
+        }
+        const size_t regressions = Compare(results, previous, tolerance);
+        printf("%zu regressions over %.0f%% against %s\n", regressions, tolerance * 100.0, baseline);
+        return regressions ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,403 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "../Engine/Parallel.h"
+#include "../ThirdParty/glm/glm.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Writes closed spheres and tori and open terrain grids of any size as OBJ, streamed row block by
+// row block so 100M-triangle meshes never exist in memory. Every surface is a regular grid:
+//   sphere:  two poles plus (rings - 1) rings of 'segments' vertices, 2 * segments * (rings - 1) triangles.
+//   torus:   rings x segments, wrapping both ways, 2 * rings * segments triangles.
+//   terrain: (rings + 1) x (segments + 1) heights, 2 * rings * segments triangles.
+// Noise is fractal value noise along the normal (the height for terrain), a pure function of the
+// position and the seed, so a mesh is the same for any worker count.
+namespace
+{
+    constexpr double PI = 3.14159265358979323846;
+    constexpr size_t ROWS_PER_TASK = 64;
+
+    enum class Shape { Sphere, Torus, Terrain };
+
+    struct GenerateOptions
+    {
+        Shape shape = Shape::Sphere;
+        uint64_t triangles = 1000000;
+        float noise = 0.05f;    // displacement amplitude relative to the shape size.
+        float frequency = 4.0f; // noise cells across the shape.
+        uint32_t octaves = 4;
+        uint32_t seed = 1;
+    };
+
+    inline uint32_t Hash(int32_t x, int32_t y, int32_t z, uint32_t seed)
+    {
+        uint32_t h = seed * 0x9E3779B9u ^ (uint32_t)x * 0x85EBCA6Bu ^ (uint32_t)y * 0xC2B2AE35u ^ (uint32_t)z * 0x27D4EB2Fu;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        h *= 0x297A2D39u;
+        h ^= h >> 15;
+        return h;
+    }
+
+    inline float Lattice(int32_t x, int32_t y, int32_t z, uint32_t seed)
+    {
+        return (float)(Hash(x, y, z, seed) & 0xFFFFFF) / (float)0x800000 - 1.0f;
+    }
+
+    // Trilinear value noise with smoothstep weights, in [-1, 1].
+    float ValueNoise(glm::vec3 p, uint32_t seed)
+    {
+        const glm::vec3 cell = glm::floor(p);
+        const glm::vec3 f = p - cell;
+        const glm::vec3 w = f * f * (3.0f - 2.0f * f);
+        const int32_t x = (int32_t)cell.x, y = (int32_t)cell.y, z = (int32_t)cell.z;
+
+        float corners[8];
+        for (int i = 0; i < 8; ++i)
+            corners[i] = Lattice(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2), seed);
+        const float x00 = corners[0] + (corners[1] - corners[0]) * w.x, x10 = corners[2] + (corners[3] - corners[2]) * w.x;
+        const float x01 = corners[4] + (corners[5] - corners[4]) * w.x, x11 = corners[6] + (corners[7] - corners[6]) * w.x;
+        const float y0 = x00 + (x10 - x00) * w.y, y1 = x01 + (x11 - x01) * w.y;
+        return y0 + (y1 - y0) * w.z;
+    }
+
+    float Fractal(glm::vec3 p, const GenerateOptions& options)
+    {
+        float sum = 0.0f, amplitude = 1.0f, total = 0.0f;
+        for (uint32_t o = 0; o < options.octaves; ++o)
+        {
+            sum += amplitude * ValueNoise(p, options.seed + o);
+            total += amplitude;
+            amplitude *= 0.5f;
+            p *= 2.0f;
+        }
+        return total > 0.0f ? sum / total : 0.0f;
+    }
+
+    struct Grid
+    {
+        uint32_t rings;
+        uint32_t segments;
+        uint64_t vertex_count;
+        uint64_t triangle_count;
+    };
+
+    // Rings of about twice as many segments keep the sphere and torus cells close to square.
+    Grid MakeGrid(const GenerateOptions& options)
+    {
+        Grid grid;
+        const double t = (double)options.triangles;
+        switch (options.shape)
+        {
+        case Shape::Sphere:
+        case Shape::Torus:
+            grid.rings = (uint32_t)std::max(3.0, std::round(std::sqrt(t / 4.0)));
+            grid.segments = (uint32_t)std::max(3.0, std::round(t / (2.0 * grid.rings)));
+            break;
+        case Shape::Terrain:
+            grid.rings = (uint32_t)std::max(1.0, std::round(std::sqrt(t / 2.0)));
+            grid.segments = (uint32_t)std::max(1.0, std::round(t / (2.0 * grid.rings)));
+            break;
+        }
+
+        switch (options.shape)
+        {
+        case Shape::Sphere:
+            grid.vertex_count = 2 + (uint64_t)(grid.rings - 1) * grid.segments;
+            grid.triangle_count = 2ull * grid.segments * (grid.rings - 1);
+            break;
+        case Shape::Torus:
+            grid.vertex_count = (uint64_t)grid.rings * grid.segments;
+            grid.triangle_count = 2ull * grid.rings * grid.segments;
+            break;
+        case Shape::Terrain:
+            grid.vertex_count = (uint64_t)(grid.rings + 1) * (grid.segments + 1);
+            grid.triangle_count = 2ull * grid.rings * grid.segments;
+            break;
+        }
+        return grid;
+    }
+
+    glm::vec3 Displace(glm::vec3 position, glm::vec3 normal, const GenerateOptions& options)
+    {
+        if (options.noise == 0.0f)
+            return position;
+        return position + normal * (options.noise * Fractal(position * options.frequency, options));
+    }
+
+    class ObjStream
+    {
+    public:
+        explicit ObjStream(const char* file_name) : m_File(std::fopen(file_name, "wb")) {}
+        ~ObjStream() { if (m_File) std::fclose(m_File); }
+
+        inline bool IsOpen() const { return m_File != nullptr; }
+
+        void Write(const std::string& text)
+        {
+            m_Ok = m_Ok && std::fwrite(text.data(), 1, text.size(), m_File) == text.size();
+        }
+
+        bool Close()
+        {
+            const bool ok = m_Ok && std::fclose(m_File) == 0;
+            m_File = nullptr;
+            return ok;
+        }
+
+    private:
+        FILE* m_File;
+        bool m_Ok = true;
+    };
+
+    inline void AppendFloat(std::string& out, float value)
+    {
+        char buffer[32];
+        const std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    inline void AppendIndex(std::string& out, uint64_t value)
+    {
+        char buffer[24];
+        const std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    inline void AppendVertex(std::string& out, glm::vec3 p)
+    {
+        out += "v ";
+        AppendFloat(out, p.x);
+        out += ' ';
+        AppendFloat(out, p.y);
+        out += ' ';
+        AppendFloat(out, p.z);
+        out += '\n';
+    }
+
+    inline void AppendFace(std::string& out, uint64_t a, uint64_t b, uint64_t c)
+    {
+        out += "f ";
+        AppendIndex(out, a + 1);
+        out += ' ';
+        AppendIndex(out, b + 1);
+        out += ' ';
+        AppendIndex(out, c + 1);
+        out += '\n';
+    }
+
+    // Vertices of row 'r' (for the sphere, ring r + 1; the poles are written apart).
+    void VertexRow(const Grid& grid, const GenerateOptions& options, uint32_t r, std::string& out)
+    {
+        for (uint32_t s = 0; s < (options.shape == Shape::Terrain ? grid.segments + 1 : grid.segments); ++s)
+        {
+            glm::vec3 position, normal;
+            switch (options.shape)
+            {
+            case Shape::Sphere:
+            {
+                const double theta = PI * (r + 1) / grid.rings, phi = 2.0 * PI * s / grid.segments;
+                normal = glm::vec3((float)(std::sin(theta) * std::cos(phi)), (float)std::cos(theta), (float)(std::sin(theta) * std::sin(phi)));
+                position = normal;
+                break;
+            }
+            case Shape::Torus:
+            {
+                constexpr double MAJOR = 1.0, MINOR = 0.35;
+                const double u = 2.0 * PI * r / grid.rings, v = 2.0 * PI * s / grid.segments;
+                normal = glm::vec3((float)(std::cos(v) * std::cos(u)), (float)std::sin(v), (float)(std::cos(v) * std::sin(u)));
+                position = glm::vec3((float)((MAJOR + MINOR * std::cos(v)) * std::cos(u)), (float)(MINOR * std::sin(v)), (float)((MAJOR + MINOR * std::cos(v)) * std::sin(u)));
+                break;
+            }
+            case Shape::Terrain:
+                normal = glm::vec3(0.0f, 1.0f, 0.0f);
+                position = glm::vec3((float)s / grid.segments * 2.0f - 1.0f, 0.0f, (float)r / grid.rings * 2.0f - 1.0f);
+                break;
+            }
+            AppendVertex(out, Displace(position, normal, options));
+        }
+    }
+
+    // The two triangles of every cell of band 'r', counter-clockwise seen from outside.
+    void FaceRow(const Grid& grid, const GenerateOptions& options, uint32_t r, std::string& out)
+    {
+        const uint64_t n = grid.segments;
+        switch (options.shape)
+        {
+        case Shape::Sphere:
+        {
+            // Vertex 0 is the north pole, ring k starts at 1 + k * n, the south pole is last.
+            const uint64_t south = grid.vertex_count - 1;
+            for (uint64_t s = 0; s < n; ++s)
+            {
+                const uint64_t s1 = (s + 1) % n;
+                if (r == 0)
+                    AppendFace(out, 0, 1 + s1, 1 + s);
+                else if (r == grid.rings - 1)
+                    AppendFace(out, south, 1 + (r - 1) * n + s, 1 + (r - 1) * n + s1);
+                else
+                {
+                    const uint64_t a = 1 + (r - 1) * n, b = 1 + r * n;
+                    AppendFace(out, a + s, a + s1, b + s);
+                    AppendFace(out, a + s1, b + s1, b + s);
+                }
+            }
+            break;
+        }
+        case Shape::Torus:
+        {
+            const uint64_t a = (uint64_t)r * n, b = (uint64_t)((r + 1) % grid.rings) * n;
+            for (uint64_t s = 0; s < n; ++s)
+            {
+                const uint64_t s1 = (s + 1) % n;
+                AppendFace(out, a + s, a + s1, b + s);
+                AppendFace(out, a + s1, b + s1, b + s);
+            }
+            break;
+        }
+        case Shape::Terrain:
+        {
+            const uint64_t a = (uint64_t)r * (n + 1), b = (uint64_t)(r + 1) * (n + 1);
+            for (uint64_t s = 0; s < n; ++s)
+            {
+                AppendFace(out, a + s, b + s, a + s + 1);
+                AppendFace(out, a + s + 1, b + s, b + s + 1);
+            }
+            break;
+        }
+        }
+    }
+
+    // Rows are formatted in parallel a block at a time and written in order.
+    template <typename RowWriter>
+    void WriteRows(ObjStream& stream, uint32_t row_count, RowWriter&& row_writer)
+    {
+        const size_t workers = Parallel::WorkerCount();
+        std::vector<std::string> texts(workers * 4);
+        for (uint32_t first = 0; first < row_count; first += (uint32_t)(texts.size() * ROWS_PER_TASK))
+        {
+            const size_t tasks = std::min<size_t>(texts.size(), (row_count - first + ROWS_PER_TASK - 1) / ROWS_PER_TASK);
+            Parallel::For(tasks, 1, [&](size_t begin, size_t end, size_t)
+            {
+                for (size_t task = begin; task < end; ++task)
+                {
+                    std::string& text = texts[task];
+                    text.clear();
+                    const uint32_t row = first + (uint32_t)(task * ROWS_PER_TASK);
+                    const uint32_t last = std::min<uint32_t>(row_count, row + (uint32_t)ROWS_PER_TASK);
+                    for (uint32_t r = row; r < last; ++r)
+                        row_writer(r, text);
+                }
+            });
+            for (size_t task = 0; task < tasks; ++task)
+                stream.Write(texts[task]);
+        }
+    }
+
+    bool Generate(const char* file_name, const GenerateOptions& options, Grid& grid)
+    {
+        ObjStream stream(file_name);
+        if (!stream.IsOpen())
+            return false;
+
+        grid = MakeGrid(options);
+        std::string header = "# qem-generate " + std::to_string(grid.vertex_count) + " vertices, " + std::to_string(grid.triangle_count) + " triangles\n";
+        if (options.shape == Shape::Sphere)
+            AppendVertex(header, Displace(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), options));
+        stream.Write(header);
+
+        const uint32_t vertex_rows = options.shape == Shape::Sphere ? grid.rings - 1 : (options.shape == Shape::Torus ? grid.rings : grid.rings + 1);
+        WriteRows(stream, vertex_rows, [&](uint32_t r, std::string& out) { VertexRow(grid, options, r, out); });
+        if (options.shape == Shape::Sphere)
+        {
+            std::string pole;
+            AppendVertex(pole, Displace(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), options));
+            stream.Write(pole);
+        }
+        WriteRows(stream, grid.rings, [&](uint32_t r, std::string& out) { FaceRow(grid, options, r, out); });
+        return stream.Close();
+    }
+
+    // Accepts plain numbers and k/M/G suffixes: 100k, 2.5M.
+    uint64_t ParseCount(const char* text)
+    {
+        char* end = nullptr;
+        const double value = std::strtod(text, &end);
+        double scale = 1.0;
+        if (end && (*end == 'k' || *end == 'K')) scale = 1e3;
+        else if (end && (*end == 'm' || *end == 'M')) scale = 1e6;
+        else if (end && (*end == 'g' || *end == 'G')) scale = 1e9;
+        return (uint64_t)(value * scale);
+    }
+
+    void PrintUsage()
+    {
+        printf("Usage: qem-generate <sphere | torus | terrain> <triangles> <out.obj> [options]\n"
+               "  <triangles>           approximate count, k/M/G suffixes allowed (100k .. 100M)\n"
+               "  --noise <f>           displacement amplitude, 0 = smooth (default 0.05)\n"
+               "  --frequency <f>       noise cells across the shape (default 4)\n"
+               "  --octaves <n>         fractal octaves (default 4)\n"
+               "  --seed <n>            noise seed (default 1)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    GenerateOptions options;
+    if (!std::strcmp(argv[1], "sphere")) options.shape = Shape::Sphere;
+    else if (!std::strcmp(argv[1], "torus")) options.shape = Shape::Torus;
+    else if (!std::strcmp(argv[1], "terrain")) options.shape = Shape::Terrain;
+    else
+    {
+        printf("[Error] Unknown shape: %s\n", argv[1]);
+        return 2;
+    }
+    options.triangles = ParseCount(argv[2]);
+    const char* output = argv[3];
+
+    for (int i = 4; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--noise") && has_value) options.noise = (float)std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--frequency") && has_value) options.frequency = (float)std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--octaves") && has_value) options.octaves = (uint32_t)std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed") && has_value) options.seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    // Index and row arithmetic is 32-bit per row and 64-bit overall; the loader indexes in 32 bits.
+    if (options.triangles < 8 || options.triangles > 2000000000ull)
+    {
+        printf("[Error] Triangle count out of range: %s\n", argv[2]);
+        return 2;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    Grid grid;
+    if (!Generate(output, options, grid))
+    {
+        printf("[Error] Fail trying to write the file: %s\n", output);
+        return 1;
+    }
+    printf("%s: %llu vertices, %llu triangles (%u x %u) in %.2fs\n", output,
+        (unsigned long long)grid.vertex_count, (unsigned long long)grid.triangle_count, grid.rings, grid.segments,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,379 @@
+#include "../Engine/MeshOptimizer.h"
+#include "../Engine/Model.h"
+#include "../Engine/ObjWriter.h"
+#include "../Engine/Parallel.h"
+#include "../Engine/Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct CliOptions
+    {
+        SimplifyOptions simplify;
+        LoadOptions load;
+        std::string output_dir;
+        std::string suffix = "_simplified";
+        std::string trace;
+        unsigned int jobs = 0;
+        bool optimize = false;
+        bool memory = false;
+    };
+
+    struct Job
+    {
+        fs::path input;
+        fs::path output;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    inline double Seconds(Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); }
+
+    double ProcessPeakMemoryMiB()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (double)usage.ru_maxrss / 1024.0;
+    }
+
+    // The kernel keeps the high-water mark of the resident set; writing 5 to clear_refs resets it
+    // (Linux 4.0+), ru_maxrss with it. The mark is per process: with one job it is the peak of each
+    // file, with several in flight it bounds, not isolates, them and is never reset.
+    void ResetPeakMemory()
+    {
+        if (FILE* file = std::fopen("/proc/self/clear_refs", "w"))
+        {
+            std::fputs("5", file);
+            std::fclose(file);
+        }
+    }
+
+    double PeakMemoryMiB()
+    {
+        if (FILE* file = std::fopen("/proc/self/status", "r"))
+        {
+            char line[256];
+            double kib = -1.0;
+            while (kib < 0.0 && std::fgets(line, sizeof(line), file))
+                if (!std::strncmp(line, "VmHWM:", 6)) kib = std::atof(line + 6);
+            std::fclose(file);
+            if (kib >= 0.0)
+                return kib / 1024.0;
+        }
+        return ProcessPeakMemoryMiB();
+    }
+
+    const char* StopName(SimplifyStop stop)
+    {
+        switch (stop)
+        {
+        case SimplifyStop::Budget: return "budget";
+        case SimplifyStop::MaxError: return "max-error";
+        case SimplifyStop::NoValidEdges: return "no-valid-edges";
+        case SimplifyStop::Cancelled: return "cancelled";
+        }
+        return "?";
+    }
+
+    inline double MiB(size_t bytes) { return (double)bytes / (1024.0 * 1024.0); }
+
+    void AppendMemoryReport(const MemoryReport& report, std::string& line)
+    {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer), "  memory: %.1f MiB held\n", MiB(report.structure_bytes));
+        line += buffer;
+        for (const MemoryEntry& entry : report.structures)
+        {
+            std::snprintf(buffer, sizeof(buffer), "    %-22s %10.2f MiB\n", entry.name, MiB(entry.bytes));
+            line += buffer;
+        }
+        for (const MemoryEntry& entry : report.transients)
+        {
+            std::snprintf(buffer, sizeof(buffer), "    %-22s %10.2f MiB (temporary)\n", entry.name, MiB(entry.bytes));
+            line += buffer;
+        }
+        for (const MemoryPhase& phase : report.phases)
+        {
+            std::snprintf(buffer, sizeof(buffer), "    phase %-16s %10.2f MiB peak, %.2f MiB after\n", phase.name, MiB(phase.peak), MiB(phase.retained));
+            line += buffer;
+        }
+    }
+
+    void PrintUsage()
+    {
+        printf("Usage: qem-simplify [options] <file.obj | directory>...\n"
+               "  -r, --ratio <f>        keep this fraction of the triangles (default 0.5 unless -t/-e is given)\n"
+               "  -t, --triangles <n>    stop at n triangles\n"
+               "  -e, --max-error <f>    never collapse an edge costing more than f\n"
+               "  -s, --strategy <name>  greedy | batch | mc (default greedy)\n"
+               "      --seed <n>         seed of batch and mc\n"
+               "  -j, --jobs <n>         files simplified at once (default: one per hardware thread)\n"
+               "  -o, --output <dir>     write results here instead of next to each input\n"
+               "      --suffix <text>    appended to the output name (default _simplified)\n"
+               "      --weld <mode>      geometric | triplet | position (default geometric)\n"
+               "      --optimize         reorder the result for the vertex cache and report ACMR\n"
+               "      --memory           report the bytes of every structure and the heap peak of every phase\n"
+               "      --no-cache         neither read nor write .qemcache files\n"
+               "      --trace <file>     write a Chrome trace and print the counters (QEM_TRACE builds)\n"
+               "  -h, --help\n");
+    }
+
+    bool ParseArgs(int argc, char** argv, CliOptions& options, std::vector<std::string>& inputs)
+    {
+        bool has_limit = false;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            auto Value = [&]() -> const char*
+            {
+                if (i + 1 >= argc)
+                {
+                    printf("[Error] Missing value for %s\n", arg.c_str());
+                    return nullptr;
+                }
+                return argv[++i];
+            };
+
+            const char* value = nullptr;
+            if (arg == "-h" || arg == "--help")
+            {
+                PrintUsage();
+                std::exit(0);
+            }
+            else if (arg == "-r" || arg == "--ratio")
+            {
+                if (!(value = Value())) return false;
+                options.simplify.ratio = (float)std::atof(value);
+                has_limit = true;
+            }
+            else if (arg == "-t" || arg == "--triangles")
+            {
+                if (!(value = Value())) return false;
+                options.simplify.target_triangles = (unsigned int)std::strtoul(value, nullptr, 10);
+                has_limit = true;
+            }
+            else if (arg == "-e" || arg == "--max-error")
+            {
+                if (!(value = Value())) return false;
+                options.simplify.max_error = (float)std::atof(value);
+                has_limit = true;
+            }
+            else if (arg == "-s" || arg == "--strategy")
+            {
+                if (!(value = Value())) return false;
+                if (!std::strcmp(value, "greedy")) options.simplify.strategy = SimplifyStrategy::Greedy;
+                else if (!std::strcmp(value, "batch")) options.simplify.strategy = SimplifyStrategy::Batch;
+                else if (!std::strcmp(value, "mc")) options.simplify.strategy = SimplifyStrategy::MultipleChoice;
+                else
+                {
+                    printf("[Error] Unknown strategy: %s\n", value);
+                    return false;
+                }
+            }
+            else if (arg == "--seed")
+            {
+                if (!(value = Value())) return false;
+                options.simplify.seed = (uint32_t)std::strtoul(value, nullptr, 10);
+            }
+            else if (arg == "-j" || arg == "--jobs")
+            {
+                if (!(value = Value())) return false;
+                options.jobs = (unsigned int)std::strtoul(value, nullptr, 10);
+            }
+            else if (arg == "-o" || arg == "--output")
+            {
+                if (!(value = Value())) return false;
+                options.output_dir = value;
+            }
+            else if (arg == "--suffix")
+            {
+                if (!(value = Value())) return false;
+                options.suffix = value;
+            }
+            else if (arg == "--weld")
+            {
+                if (!(value = Value())) return false;
+                if (!std::strcmp(value, "geometric")) options.load.weld = WeldMode::Geometric;
+                else if (!std::strcmp(value, "triplet")) options.load.weld = WeldMode::IndexTriplet;
+                else if (!std::strcmp(value, "position")) options.load.weld = WeldMode::PositionIndex;
+                else
+                {
+                    printf("[Error] Unknown weld mode: %s\n", value);
+                    return false;
+                }
+            }
+            else if (arg == "--optimize")
+                options.optimize = true;
+            else if (arg == "--memory")
+                options.memory = true;
+            else if (arg == "--no-cache")
+                options.load.use_cache = false;
+            else if (arg == "--trace")
+            {
+                if (!(value = Value())) return false;
+                options.trace = value;
+            }
+            else if (!arg.empty() && arg[0] == '-')
+            {
+                printf("[Error] Unknown option: %s\n", arg.c_str());
+                return false;
+            }
+            else
+                inputs.push_back(arg);
+        }
+
+        if (!has_limit)
+            options.simplify.ratio = 0.5f;
+        return true;
+    }
+
+    // Directories are searched recursively for .obj files; outputs of a previous run are skipped.
+    // Returns the number of inputs that do not exist.
+    size_t CollectJobs(const std::vector<std::string>& inputs, const CliOptions& options, std::vector<Job>& jobs)
+    {
+        std::vector<fs::path> files;
+        size_t missing = 0;
+        for (const std::string& input : inputs)
+        {
+            std::error_code error;
+            if (fs::is_directory(input, error))
+            {
+                const size_t first = files.size();
+                for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input, error))
+                {
+                    const fs::path& path = entry.path();
+                    const std::string stem = path.stem().string();
+                    const bool output = stem.size() >= options.suffix.size() && stem.compare(stem.size() - options.suffix.size(), options.suffix.size(), options.suffix) == 0;
+                    if (entry.is_regular_file() && path.extension() == ".obj" && !output)
+                        files.push_back(path);
+                }
+                std::sort(files.begin() + first, files.end());
+            }
+            else if (fs::is_regular_file(input, error))
+                files.push_back(input);
+            else
+            {
+                printf("[Error] Fail trying to find the input: %s\n", input.c_str());
+                ++missing;
+            }
+        }
+
+        for (const fs::path& file : files)
+        {
+            const fs::path dir = options.output_dir.empty() ? file.parent_path() : fs::path(options.output_dir);
+            jobs.push_back({ file, dir / (file.stem().string() + options.suffix + ".obj") });
+        }
+        return missing;
+    }
+
+    bool RunJob(const Job& job, const CliOptions& options, bool shared_peak, std::string& line, double& peak)
+    {
+        char buffer[512];
+        if (!shared_peak)
+            ResetPeakMemory();
+        const auto start = Clock::now();
+        Model model(job.input.string().c_str(), options.load);
+        const double load = Seconds(start);
+        if (model.GetMesh().idx.empty())
+        {
+            std::snprintf(buffer, sizeof(buffer), "[Error] %s: no triangles loaded\n", job.input.string().c_str());
+            line = buffer;
+            return false;
+        }
+
+        const SimplifyResult result = model.Simplify(options.simplify);
+
+        const auto write_start = Clock::now();
+        Mesh mesh = model.GetMesh();
+        OptimizeReport report;
+        if (options.optimize)
+            report = OptimizeMesh(mesh);
+        const bool written = WriteObj(job.output.string().c_str(), mesh);
+        const double write = Seconds(write_start);
+        peak = PeakMemoryMiB();
+
+        std::snprintf(buffer, sizeof(buffer), "%s%s: %zu -> %zu tris, %s, error %.3g | load %.3fs simplify %.3fs write %.3fs | %speak %.1f MiB\n",
+            written ? "" : "[Error] Fail trying to write the output of ", job.input.string().c_str(),
+            result.initial_triangles, result.final_triangles, StopName(result.stop), result.max_error,
+            load, result.seconds, write, shared_peak ? "process " : "", peak);
+        line = buffer;
+        if (options.optimize)
+        {
+            std::snprintf(buffer, sizeof(buffer), "  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+            line += buffer;
+        }
+        if (options.memory)
+            AppendMemoryReport(model.GetMemoryReport(), line);
+        return written;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    CliOptions options;
+    options.load.use_cache = true; // off in the library, on unless --no-cache here.
+    std::vector<std::string> inputs;
+    if (!ParseArgs(argc, argv, options, inputs))
+        return 2;
+    if (inputs.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+    options.load.verbose = false;
+
+    std::vector<Job> jobs;
+    const size_t missing = CollectJobs(inputs, options, jobs);
+    if (!options.output_dir.empty())
+    {
+        std::error_code error;
+        fs::create_directories(options.output_dir, error);
+    }
+
+    // Files run side by side; each one gets an equal share of the workers for its parallel phases.
+    const unsigned int hardware = Parallel::WorkerCount();
+    const size_t job_workers = std::max<size_t>(1, std::min<size_t>(options.jobs ? options.jobs : hardware, jobs.size()));
+    Parallel::SetWorkerCount(std::max<unsigned int>(1, hardware / (unsigned int)job_workers));
+
+    const auto start = Clock::now();
+    std::atomic<size_t> failed(0);
+    std::vector<double> peaks(jobs.size(), 0.0);
+    Parallel::Queue(jobs.size(), job_workers, [&](size_t i, size_t)
+    {
+        std::string line;
+        if (!RunJob(jobs[i], options, job_workers > 1, line, peaks[i]))
+            ++failed;
+        fputs(line.c_str(), stdout);
+        fflush(stdout);
+    });
+
+    double peak = ProcessPeakMemoryMiB();
+    for (double job_peak : peaks)
+        peak = std::max(peak, job_peak);
+    printf("%zu files, %zu failed, %u jobs | total %.3fs | process peak %.1f MiB\n",
+        jobs.size(), failed.load(), (unsigned int)job_workers, Seconds(start), peak);
+
+    if (!options.trace.empty())
+    {
+#if QEM_TRACE
+        Trace::PrintCounters();
+        if (!Trace::WriteChromeTrace(options.trace.c_str()))
+            return 1;
+#else
+        printf("[Warning] Built without QEM_TRACE, no trace written: %s\n", options.trace.c_str());
+#endif
+    }
+    return failed.load() || missing || jobs.empty() ? 1 : 0;
+}